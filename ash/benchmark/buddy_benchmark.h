@@ -0,0 +1,143 @@
+#ifndef ASH_BENCHMARK_BUDDY_BENCHMARK_H
+#define ASH_BENCHMARK_BUDDY_BENCHMARK_H
+#include <ash/numeric.h>
+#include <ash/memory/buddy_system.h>
+#include <ostream>
+#include <vector>
+
+namespace ash {
+
+struct throughput_sample {
+    unsigned num_threads;
+    uint64_t num_ops;      // allocate/deallocate pairs
+    uint64_t num_failures; // allocations returned nullptr
+    double elapsed_sec;
+
+    double mops() const {
+        return elapsed_sec > 0.0 ? static_cast<double>(num_ops) / elapsed_sec / 1e6 : 0.0;
+    }
+};
+
+struct buddy_scaling_config {
+    uint64_t region_size = GiB(1);
+    unsigned align = 256;
+    unsigned min_cof = 1;
+    uint64_t min_request = 16;
+    uint64_t max_request = KiB(4);
+    uint64_t ops_per_thread = 1u << 20;
+    unsigned window = 64;       // live allocations per thread
+    unsigned max_threads = 64;  // threads are scaled by 1, 2, 4, ..., max_threads
+};
+
+// Allocate/free throughput of a buddy_system guarded by a single mutex
+std::vector<throughput_sample> bench_locked_buddy_scaling(buddy_scaling_config const& cfg);
+
+// Allocate/free throughput of concurrent_buddy_system (per-thread magazines)
+std::vector<throughput_sample> bench_concurrent_buddy_scaling(buddy_scaling_config const& cfg, unsigned magazine_size);
+
+struct buddy_route_config {
+    uint64_t region_size = GiB(64);
+    unsigned align = 256;
+    unsigned min_cof = 1;
+    uint64_t min_request = 256;
+    uint64_t max_request = MiB(64); // request sizes are log-uniform in [min_request, max_request]
+    uint64_t num_ops = 1u << 22;
+    unsigned window = 1024;         // live allocations
+};
+
+// Single-thread allocate/free throughput of buddy_system over a deep tree.
+// Build the library with ASH_BUDDY_SYSTEM_LEGACY_ROUTE_DISCOVERY to measure the step-by-step route discovery.
+throughput_sample bench_buddy_route_discovery(buddy_route_config const& cfg);
+
+// Single-thread allocate/free throughput of the pointer APIs of buddy_system (pooled block descriptors)
+// and compact_buddy_system (a byte of state per node); returns {buddy_system, compact_buddy_system}
+std::vector<throughput_sample> bench_buddy_metadata_layout(buddy_route_config const& cfg);
+
+struct buddy_slab_config {
+    uint64_t region_size = GiB(1);
+    unsigned align = 256;
+    unsigned min_cof = 1;
+    uint64_t min_request = 8;
+    uint64_t max_request = KiB(2); // request sizes are log-uniform in [min_request, max_request]
+    uint64_t num_ops = 1u << 22;
+    unsigned window = 1u << 16;     // live allocations
+};
+
+struct buddy_slab_result {
+    throughput_sample throughput;
+    uint64_t requested; // bytes requested by the live allocations at the end of the run
+    uint64_t footprint; // bytes allocated from the buddy system at the same time
+};
+
+// Single-thread allocate/free throughput and footprint of small requests on buddy_system
+// and slab_buddy_system; returns {buddy_system, slab_buddy_system}
+std::vector<buddy_slab_result> bench_buddy_slab(buddy_slab_config const& cfg);
+
+struct buddy_batch_config {
+    uint64_t region_size = GiB(1);
+    unsigned align = 256;
+    unsigned min_cof = 1;
+    uint64_t request = KiB(4);
+    unsigned batch = 512;       // blocks allocated and freed together
+    unsigned num_rounds = 4096;
+};
+
+// Allocate/free throughput of same-sized blocks in bulk, through the batched APIs of buddy_system
+// or through the single-block APIs in a loop
+throughput_sample bench_buddy_batch(buddy_batch_config const& cfg, bool batched);
+
+struct buddy_churn_config {
+    uint64_t region_size = GiB(1);
+    unsigned align = 256;
+    unsigned min_cof = 1;
+    uint64_t hot_request = KiB(4);   // the size class of the churn
+    uint64_t max_request = MiB(1);   // other requests are uniform in [hot_request, max_request]
+    unsigned hot_percent = 90;
+    uint64_t num_ops = 1u << 22;
+    unsigned window = 256;           // live allocations; a random one is replaced per operation
+};
+
+// Allocate/free throughput of buddy_system on a churn-heavy trace, with lazy coalescing if `lazy` is not null
+throughput_sample bench_buddy_churn(buddy_churn_config const& cfg, buddy_impl::lazy_coalescing_config const* lazy);
+
+struct buddy_placement_result {
+    throughput_sample throughput;
+    double external_fragmentation; // mean over samples taken every `window` operations
+    double live_span;              // mean bytes from the lowest to the highest live byte
+    uint64_t high_water;           // the highest byte ever allocated, from the base of the region
+};
+
+// The churn trace of bench_buddy_churn under a placement policy. The samples are taken in
+// a second run of the same trace, so they do not count in the throughput.
+buddy_placement_result bench_buddy_placement(buddy_churn_config const& cfg, buddy_impl::placement_policy policy);
+
+struct buddy_table_lookup_config {
+    uint64_t min_request = 16;
+    uint64_t max_request = KiB(64); // request sizes are log-uniform in [min_request, max_request]
+    uint64_t num_lookups = 1u << 24;
+};
+
+// best_fit throughput of buddy_table and static_buddy_table of the same geometry
+// (a 64 GiB region, an alignment of 256 bytes and a minimum coefficient of 1); returns {runtime, static}
+std::vector<throughput_sample> bench_buddy_table_lookup(buddy_table_lookup_config const& cfg);
+
+struct buddy_remote_free_config {
+    uint64_t region_size = GiB(1);
+    unsigned align = 256;
+    unsigned min_cof = 1;
+    uint64_t min_request = 256;
+    uint64_t max_request = KiB(64); // request sizes are uniform in [min_request, max_request]
+    uint64_t num_ops = 1u << 22;
+    unsigned num_workers = 4;
+    unsigned ring = 256;            // pointers in flight per worker
+};
+
+// A loader thread allocates buffers and hands them to workers round-robin, and the workers free them.
+// Frees go through a mutex shared with the loader, or through deallocate_remote if `remote` is true.
+throughput_sample bench_buddy_remote_free(buddy_remote_free_config const& cfg, bool remote);
+
+void print_throughput_samples(std::ostream& os, char const* title, std::vector<throughput_sample> const& samples);
+
+} // !namespace ash
+
+#endif // ASH_BENCHMARK_BUDDY_BENCHMARK_H
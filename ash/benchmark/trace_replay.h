@@ -0,0 +1,77 @@
+#ifndef ASH_BENCHMARK_TRACE_REPLAY_H
+#define ASH_BENCHMARK_TRACE_REPLAY_H
+#include <ash/memory.h>
+#include <ash/memory/alloc_trace.h>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace ash {
+
+// An allocator under replay
+class trace_replay_target {
+public:
+    virtual ~trace_replay_target() = default;
+    virtual char const* name() const = 0;
+    virtual void* allocate(uint64_t size) = 0;
+    virtual void deallocate(void* p, uint64_t size) = 0;
+    // Bytes held for the live allocations, including internal fragmentation and unused pool slots
+    virtual uint64_t footprint() const = 0;
+    // A fraction of the free memory unusable for the largest request, if the allocator reports it
+    virtual double external_fragmentation() const {
+        return 0.0;
+    }
+};
+
+std::unique_ptr<trace_replay_target> make_malloc_replay_target();
+std::unique_ptr<trace_replay_target> make_buddy_system_replay_target(memrgn_t const& rgn, unsigned align, unsigned min_cof);
+// buddy_system::allocate_exact, whose unused tail blocks are returned to the buddy system
+std::unique_ptr<trace_replay_target> make_buddy_system_exact_replay_target(memrgn_t const& rgn, unsigned align, unsigned min_cof);
+std::unique_ptr<trace_replay_target> make_portable_buddy_system_replay_target(memrgn_t const& rgn, unsigned align, unsigned min_cof);
+// unordered_object_pool per power-of-two size class up to 4 KiB; larger requests go to malloc
+std::unique_ptr<trace_replay_target> make_object_pool_replay_target();
+
+struct trace_replay_config {
+    uint64_t timeline_interval = 1u << 16; // events between timeline points
+    bool measure_latency = true;
+};
+
+struct trace_replay_point {
+    uint64_t event;
+    uint64_t timestamp_ns; // of the trace
+    uint64_t live_bytes;   // requested bytes of the live allocations
+    uint64_t footprint;
+    double external_fragmentation;
+};
+
+struct trace_replay_result {
+    constexpr static unsigned NumPercentiles = 5;
+    constexpr static double Percentiles[NumPercentiles] = { 50.0, 90.0, 99.0, 99.9, 100.0 };
+
+    std::string target;
+    uint64_t num_allocs;
+    uint64_t num_frees;
+    uint64_t num_failures;
+    double elapsed_sec;                      // of the untimed pass
+    uint64_t alloc_latency_ns[NumPercentiles];
+    uint64_t free_latency_ns[NumPercentiles];
+    uint64_t peak_live_bytes;
+    uint64_t peak_footprint;
+    std::vector<trace_replay_point> timeline;
+
+    double mops() const {
+        return elapsed_sec > 0.0 ? static_cast<double>(num_allocs + num_frees) / elapsed_sec / 1e6 : 0.0;
+    }
+};
+
+// Replays the trace twice: once for throughput, and once for latencies and the timeline.
+// Allocations left live by the trace are freed after each pass.
+trace_replay_result replay_alloc_trace(std::vector<alloc_trace_event> const& trace, trace_replay_target& target,
+    trace_replay_config const& cfg = trace_replay_config{});
+
+void print_trace_replay_result(std::ostream& os, trace_replay_result const& result, bool with_timeline = false);
+
+} // !namespace ash
+
+#endif // ASH_BENCHMARK_TRACE_REPLAY_H
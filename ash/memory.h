@@ -23,6 +23,9 @@ struct buddy_block;
 
 class buddy_system;
 class portable_buddy_system;
+class concurrent_buddy_system;
+class bitmap_buddy_system;
+class buddy_compactor;
 
 } // namespace ash
 
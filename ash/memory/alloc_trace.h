@@ -0,0 +1,78 @@
+#ifndef ASH_MEMORY_ALLOC_TRACE_H
+#define ASH_MEMORY_ALLOC_TRACE_H
+#include <ash/detail/noncopyable.h>
+#include <chrono>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include <stdint.h>
+#include <stdio.h>
+
+namespace ash {
+
+enum class alloc_trace_op : uint8_t {
+    Allocate = 0,
+    Deallocate = 1,
+};
+
+struct alloc_trace_event {
+    alloc_trace_op op;
+    uint32_t id;           // an object id; ids of freed objects are reused
+    uint64_t size;         // requested bytes (allocation only)
+    uint64_t timestamp_ns; // since the recorder was opened
+};
+
+/*
+ * Records allocation events into a compact binary trace.
+ *
+ * Trace format
+ * - header: "ASHTRACE", version (u32), reserved (u32)
+ * - event: op (u8), time delta in ns (varint), object id (varint), size (varint, allocation only)
+ * Pointers are replaced by dense object ids, so a trace can be replayed against any allocator.
+ *
+ * Any thread may record events; events are serialized by a mutex.
+ * buddy_system records its pointer APIs into an attached recorder if the library is built
+ * with ASH_BUDDY_SYSTEM_ALLOCATION_TRACE.
+ */
+class alloc_trace_recorder : noncopyable {
+public:
+    constexpr static uint32_t Version = 1;
+
+    alloc_trace_recorder();
+    ~alloc_trace_recorder() noexcept;
+    bool open(char const* path);
+    void close() noexcept;
+    void on_allocate(void const* p, uint64_t size);
+    void on_deallocate(void const* p);
+
+    bool is_open() const {
+        return _fp != nullptr;
+    }
+
+    uint64_t num_events() const {
+        return _num_events;
+    }
+
+protected:
+    using clock = std::chrono::steady_clock;
+
+    void _put_event(alloc_trace_op op, uint32_t id, uint64_t size);
+    void _put_varint(uint64_t v);
+    void _flush();
+
+    std::mutex _mtx;
+    FILE* _fp;
+    std::vector<uint8_t> _buf;
+    std::unordered_map<void const*, uint32_t> _ids;
+    std::vector<uint32_t> _free_ids;
+    uint32_t _next_id;
+    clock::time_point _last;
+    uint64_t _num_events;
+};
+
+// Reads every event of a trace written by alloc_trace_recorder
+bool load_alloc_trace(char const* path, std::vector<alloc_trace_event>& events);
+
+} // !namespace ash
+
+#endif // ASH_MEMORY_ALLOC_TRACE_H
@@ -0,0 +1,92 @@
+#ifndef ASH_MEMORY_BITMAP_BUDDY_SYSTEM_H
+#define ASH_MEMORY_BITMAP_BUDDY_SYSTEM_H
+#include <ash/memory.h>
+#include <ash/memory/buddy_table.h>
+#include <ash/detail/noncopyable.h>
+#include <atomic>
+
+namespace ash {
+
+/*
+ * Lock-free buddy system over a packed bitmap tree.
+ *
+ * The allocation tree is the full binary tree described by buddy_table (linear levels
+ * followed by the A1B3/A3B1 binary levels); nodes are numbered in heap order and each of
+ * them is a single byte of state updated by CAS, so no block descriptors are allocated
+ * and any number of threads can allocate and free concurrently.
+ *
+ * Node state bits
+ * +--------+-----------------------------------------------------+
+ * |  OCC   | the node itself is allocated                        |
+ * | OCC_L  | the left subtree holds an allocation                |
+ * | OCC_R  | the right subtree holds an allocation               |
+ * | COAL_L | a release of the left subtree is being propagated   |
+ * | COAL_R | a release of the right subtree is being propagated  |
+ * +--------+-----------------------------------------------------+
+ * A node is free iff its state is zero. Allocation marks a free node as busy and then
+ * sets the OCC_L/OCC_R bit on every ancestor (rolling back if an ancestor is allocated);
+ * release marks COAL bits on the path to the root first, clears the node, and then
+ * clears OCC/COAL bits as long as the buddy is free.
+ *
+ * Like buddy_system, the node of a block is recorded in the first 8 bytes of the block.
+ */
+class bitmap_buddy_system : noncopyable {
+public:
+    using node_t = uint64_t;
+    constexpr static unsigned MaxLevels = 48; // exclusive; the tree takes 2^levels bytes
+
+    bitmap_buddy_system();
+    ~bitmap_buddy_system() noexcept;
+    bitmap_buddy_system(memrgn_t const& rgn, unsigned align, unsigned min_cof);
+    void init(memrgn_t const& rgn, unsigned align, unsigned min_cof);
+    void* allocate(uint64_t size);
+    void deallocate(void* p);
+
+    memrgn_t const& rgn() const {
+        return _rgn;
+    }
+
+    uint64_t max_alloc() const {
+        return _max_blk_size;
+    }
+
+    uint64_t allocated_size() const {
+        return _total_allocated_size.load(std::memory_order_relaxed);
+    }
+
+    buddy_impl::buddy_table const& table() const {
+        return _tbl;
+    }
+
+protected:
+    constexpr static uint8_t OccRight = 0x1u;
+    constexpr static uint8_t OccLeft = 0x1u << 1;
+    constexpr static uint8_t CoalRight = 0x1u << 2;
+    constexpr static uint8_t CoalLeft = 0x1u << 3;
+    constexpr static uint8_t Occ = 0x1u << 4;
+    constexpr static uint8_t Busy = Occ | OccLeft | OccRight;
+
+    static unsigned _depth(node_t const n) {
+        return log2u_nz(n);
+    }
+
+    node_t _scan_level(buddy_impl::level_t lv, uint64_t lo, uint64_t hi, buddy_impl::cof_type need, bool check_cof);
+    node_t _try_alloc(node_t n);
+    void _free_node(node_t n, unsigned upper_bound);
+    void _unmark(node_t n, unsigned upper_bound);
+    void _cleanup();
+
+    memrgn_t _rgn;
+    unsigned _align;
+    uint64_t _max_blk_size;
+    unsigned _num_levels;
+    std::atomic<uint8_t>* _tree;
+    std::atomic<uint64_t>* _hint;       // per-level scan hints
+    buddy_impl::cof_type* _lv_min_cof;  // the smallest coefficient of each level
+    std::atomic<int64_t> _total_allocated_size;
+    buddy_impl::buddy_table _tbl;
+};
+
+} // !namespace ash
+
+#endif // ASH_MEMORY_BITMAP_BUDDY_SYSTEM_H
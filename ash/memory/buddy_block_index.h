@@ -0,0 +1,71 @@
+#ifndef ASH_MEMORY_BUDDY_BLOCK_INDEX_H
+#define ASH_MEMORY_BUDDY_BLOCK_INDEX_H
+#include <ash/memory.h>
+#include <ash/config/compiler.h>
+#include <ash/detail/noncopyable.h>
+#include <assert.h>
+
+namespace ash {
+namespace buddy_impl {
+
+/*
+ * Address-to-block index of a buddy region.
+ *
+ * Every block begins at a multiple of the alignment from the region base, so a block is keyed
+ * by (p - base) / align. Keys are split into a directory entry and a leaf entry of a two-level
+ * page table; leaves (2^LeafBits pointers) are allocated on the first insertion into their range.
+ */
+class block_index : noncopyable {
+public:
+    constexpr static unsigned LeafBits = 12;
+    constexpr static uint64_t LeafSize = uint64_t{ 1 } << LeafBits;
+
+    block_index();
+    ~block_index() noexcept;
+    bool init(memrgn_t const& rgn, unsigned align);
+    void clear() noexcept;
+    bool insert(void const* p, buddy_block* blk);
+
+    ASH_FORCEINLINE buddy_block* find(void const* p) const {
+        uint64_t const key = _key(p);
+        buddy_block* const* leaf = _dir[key >> LeafBits];
+        return leaf != nullptr ? leaf[key & (LeafSize - 1)] : nullptr;
+    }
+
+    ASH_FORCEINLINE buddy_block* erase(void const* p) {
+        uint64_t const key = _key(p);
+        buddy_block** leaf = _dir[key >> LeafBits];
+        assert(leaf != nullptr);
+        buddy_block* const blk = leaf[key & (LeafSize - 1)];
+        leaf[key & (LeafSize - 1)] = nullptr;
+        return blk;
+    }
+
+    bool initialized() const {
+        return _dir != nullptr;
+    }
+
+    uint64_t footprint() const {
+        return _dir_size * sizeof(buddy_block**) + _num_leaves * LeafSize * sizeof(buddy_block*);
+    }
+
+protected:
+    ASH_FORCEINLINE uint64_t _key(void const* p) const {
+        uint64_t const off = static_cast<uint64_t>(static_cast<char const*>(p) - _base);
+        assert(off < _size);
+        return _shift >= 0 ? off >> _shift : off / _align;
+    }
+
+    char const* _base;
+    uint64_t _size;
+    unsigned _align;
+    int _shift; // log2(align) if the alignment is a power of two, otherwise -1
+    buddy_block*** _dir;
+    uint64_t _dir_size;
+    uint64_t _num_leaves;
+};
+
+} // !namespace buddy_impl
+} // !namespace ash
+
+#endif // ASH_MEMORY_BUDDY_BLOCK_INDEX_H
@@ -0,0 +1,96 @@
+#ifndef ASH_MEMORY_BUDDY_COMPACTOR_H
+#define ASH_MEMORY_BUDDY_COMPACTOR_H
+#include <ash/memory/buddy_system.h>
+#include <ash/detail/noncopyable.h>
+#include <functional>
+#include <vector>
+
+namespace ash {
+
+enum class compaction_status {
+    Idle = 0,    // no plan
+    InProgress,
+    Done,        // the target region is free
+    OutOfMemory, // a block could not be moved; step() may be retried after frees
+};
+
+/*
+ * Incremental compaction of a buddy system.
+ *
+ * plan(size) selects the subtree of at least `size` bytes holding the fewest live bytes,
+ * and fences it: free blocks inside the subtree are pinned, and blocks freed inside it
+ * are pinned as well, so no allocation lands in the subtree while it is being emptied.
+ * step(budget) moves live blocks out of the subtree until `budget` bytes are moved.
+ * A block is moved by allocating a new block, invoking the relocation callback
+ * (which copies the data and updates references), and freeing the old block.
+ * The fence is lifted when the subtree is empty, so the subtree is merged into a free block.
+ * Blocks of allocate_aligned and allocate_exact are never moved (their pointers are not at the
+ * block headers, and an exact allocation spans several blocks), so a subtree holding one is
+ * never planned.
+ *
+ * The compactor must be driven by the owner of the buddy system, between other operations.
+ */
+class buddy_compactor : noncopyable {
+    using buddy_block = buddy_impl::buddy_block;
+public:
+    // from, to: pointers returned by the buddy system, size: bytes to be copied
+    // (every usable byte of the moved block, which may be more than requested; `to` may be larger)
+    using relocate_callback_t = std::function<void(void* from, void* to, uint64_t size)>;
+
+    // block_headers: blocks are allocated by buddy_system::allocate (with block headers),
+    // otherwise by allocate_block
+    buddy_compactor(buddy_system& buddy, relocate_callback_t callback, bool block_headers = true);
+    ~buddy_compactor() noexcept;
+    bool plan(uint64_t size);
+    compaction_status step(uint64_t budget);
+    void abort();
+
+    compaction_status status() const {
+        return _status;
+    }
+
+    memrgn_t const& target() const {
+        return _target;
+    }
+
+    uint64_t planned_bytes() const {
+        return _planned_bytes;
+    }
+
+    uint64_t moved_bytes() const {
+        return _moved_bytes;
+    }
+
+    uint64_t num_moves() const {
+        return _num_moves;
+    }
+
+protected:
+    struct candidate {
+        buddy_block* node;
+        uint64_t cost; // live bytes to be moved
+    };
+
+    static bool _is_split(buddy_block const* node) {
+        return node->left != nullptr;
+    }
+
+    static uint64_t _live_bytes(buddy_block const* node);
+    static bool _is_movable(buddy_block const* node);
+    void _survey(buddy_block* node, uint64_t size, candidate& best) const;
+    void _fence_subtree(buddy_block* node);
+
+    buddy_system& _buddy;
+    relocate_callback_t _callback;
+    bool _block_headers;
+    compaction_status _status;
+    memrgn_t _target;
+    std::vector<buddy_block*> _pending; // live blocks to be moved
+    uint64_t _planned_bytes;
+    uint64_t _moved_bytes;
+    uint64_t _num_moves;
+};
+
+} // !namespace ash
+
+#endif // ASH_MEMORY_BUDDY_COMPACTOR_H
@@ -0,0 +1,66 @@
+#ifndef ASH_MEMORY_BUDDY_ROUTE_TABLE_H
+#define ASH_MEMORY_BUDDY_ROUTE_TABLE_H
+#include <ash/memory/buddy_table.h>
+
+namespace ash {
+namespace buddy_impl {
+
+struct route_entry {
+    blkidx_t idx;  // a block index on the route
+    bool offset;   // a child to be selected (0: left, 1: right)
+};
+
+/*
+ * Precomputed routes of buddy_system::_create_route.
+ *
+ * For every target block index, the route discovery of the buddy system probes free lists
+ * of a fixed sequence of block indices (the target, its neighbor, and candidates of
+ * every ancestor level) while it appends route entries. The sequence only depends on the
+ * buddy table, so it is recorded once:
+ * - candidates(t): a bitmask of the probed block indices
+ * - order(t, i): an order of the first probe of a block index i
+ * - prefix(t, i): the number of route entries appended before i is probed
+ * - route(t): the route entries in the order of being appended
+ *
+ * Given a bitmask of non-empty free lists, the nearest usable ancestor is the highest
+ * set bit of (candidates(t) & mask), since block indices grow with the level.
+ */
+class buddy_route_table : noncopyable {
+public:
+    constexpr static unsigned MaskWords = 2;
+    constexpr static unsigned MaxTableSize = MaskWords * 64;
+
+    buddy_route_table();
+    ~buddy_route_table() noexcept;
+    bool init(buddy_table const& tbl);
+    void clear() noexcept;
+
+    uint64_t const* candidates(blkidx_t const target) const {
+        return &_cand_v[target * MaskWords];
+    }
+
+    unsigned order(blkidx_t const target, blkidx_t const idx) const {
+        return _order_v[target * _tbl_size + idx];
+    }
+
+    unsigned prefix(blkidx_t const target, blkidx_t const idx) const {
+        return _prefix_v[target * _tbl_size + idx];
+    }
+
+    route_entry const* route(blkidx_t const target) const {
+        return &_route_v[target * _route_size];
+    }
+
+protected:
+    unsigned _tbl_size;
+    unsigned _route_size;
+    uint64_t* _cand_v;
+    uint8_t* _order_v;
+    uint8_t* _prefix_v;
+    route_entry* _route_v;
+};
+
+} // !namespace buddy_impl
+} // !namespace ash
+
+#endif // ASH_MEMORY_BUDDY_ROUTE_TABLE_H
@@ -2,9 +2,20 @@
 #define _ASH_MEMORY_BUDDY_SYSTEM_H_
 #include <ash/memory.h>
 #include <ash/memory/buddy_table.h>
+#include <ash/memory/buddy_route_table.h>
+#include <ash/memory/buddy_block_index.h>
+#include <ash/memory/remote_free_inbox.h>
+#include <ash/pointer.h>
 #include <ash/pooling_list.h>
 #include <ash/bitstack.h>
 #include <string.h> // memset
+#include <atomic>
+#include <functional>
+#include <new>
+#include <vector>
+#ifdef ASH_BUDDY_SYSTEM_ALLOCATION_TRACE
+#include <ash/memory/alloc_trace.h>
+#endif // !ASH_BUDDY_SYSTEM_ALLOCATION_TRACE
 
 namespace ash {
 
@@ -23,25 +34,197 @@ struct buddy_block {
     cof_type cof;
     buddy_block* pair;
     buddy_block* parent;
+    buddy_block* left;  // a left child of a split block, otherwise nullptr
     bool in_use;
+    bool pinned;        // held by a compaction fence
+    bool fixed;         // an allocation which buddy_compactor must not move (e.g. aligned)
+    uint32_t lazy;      // 1 + a position in the lazy list of the level if freed without merging, otherwise 0
     free_list_t::node_pointer inv;
     blkidx_t blkidx;
+    uint32_t gen;       // odd while in a free list under address-ordered placement
     memrgn_t rgn;
+    uint64_t requested; // bytes requested for an allocated block
+};
+
+/*
+ * Lazy coalescing: a freed block whose buddy is free is kept in the free list without merging
+ * while the number of such blocks at its level is under the limit of the level.
+ * Deferred merges are carried out when an allocation misses, or when bytes of the lazily freed
+ * blocks exceed the watermark.
+ */
+struct lazy_coalescing_config {
+    unsigned default_limit = 64;        // lazily freed blocks per level
+    std::vector<unsigned> level_limits; // overrides default_limit for levels [0, size)
+    uint64_t watermark = 0;             // 0: no watermark
+};
+
+/*
+ * Which free block of a list is reused.
+ * Mixed: split halves are reused first and freed blocks last (the default).
+ * AddressOrdered: the lowest address first; live blocks gather at the bottom of the region,
+ * so free blocks are more likely to find their buddies and the working set stays small.
+ */
+enum class placement_policy {
+    Mixed = 0,
+    Lifo,
+    Fifo,
+    AddressOrdered,
+};
+
+enum class pressure_level {
+    Normal = 0,
+    Low,
+    High,
+    Critical,
+};
+
+constexpr unsigned NumPressureLevels = 4;
+
+/*
+ * Memory-pressure watermarks in allocated bytes (0 disables a watermark).
+ * A level is entered when the allocated bytes reach its watermark, and left when they fall
+ * below the watermark by more than the hysteresis, so allocations and frees around a
+ * watermark do not fire the callbacks over and over.
+ */
+struct pressure_config {
+    uint64_t low = 0;
+    uint64_t high = 0;
+    uint64_t critical = 0;
+    uint64_t hysteresis = 0;
+};
+
+struct pressure_event {
+    pressure_level level;
+    pressure_level previous;
+    uint64_t allocated_size;
+    uint64_t capacity;
+};
+
+struct alloc_failure {
+    uint64_t requested;      // bytes of the failed block request (including a header)
+    uint64_t allocated_size;
+    uint64_t free_size;      // bytes of free blocks
+    uint64_t largest_free;   // bytes of the largest free block
+};
+
+enum class realloc_path {
+    Unchanged = 0, // the block already fits
+    Grown,         // free buddies on the right were absorbed
+    Shrunk,        // unused right halves were returned
+    Moved,         // allocated, copied and freed
+    Failed,
+};
+
+constexpr unsigned NumReallocPaths = 5;
+
+struct buddy_level_stats {
+    blkidx_t blkidx;
+    cof_type cof;
+    uint64_t num_free;
+    uint64_t num_used;
+};
+
+/*
+ * Telemetry of a buddy system.
+ * Counters are read one by one without stopping allocation, so a snapshot taken while the
+ * system is in use may be skewed by the operations in flight.
+ */
+struct buddy_system_snapshot {
+    constexpr static unsigned HistogramSize = 64;
+
+    uint64_t capacity;
+    uint64_t free_size;      // bytes of free blocks
+    uint64_t used_size;      // bytes of allocated blocks (cof * align)
+    uint64_t requested_size; // bytes requested for the allocated blocks
+    uint64_t largest_free;   // bytes of the largest free block
+    uint64_t num_requests;
+    uint64_t request_histogram[HistogramSize]; // [i]: requests of [2^i, 2^(i+1)) bytes
+    uint64_t realloc_count[NumReallocPaths];    // indexed by realloc_path
+    std::vector<buddy_level_stats> levels;
+
+    // 0 if every free byte is in the largest free block
+    double external_fragmentation() const {
+        return free_size > 0 ? 1.0 - static_cast<double>(largest_free) / static_cast<double>(free_size) : 0.0;
+    }
+
+    // A fraction of the allocated bytes not requested
+    double internal_fragmentation() const {
+        return used_size > 0 ? 1.0 - static_cast<double>(requested_size) / static_cast<double>(used_size) : 0.0;
+    }
+
+    void printout() const;
 };
 
 } // namespace buddy_impl
 
 class buddy_system {
     using buddy_block = buddy_impl::buddy_block;
+    friend class buddy_compactor;
 public:
+    using pressure_callback_t = std::function<void(buddy_system&, buddy_impl::pressure_event const&)>;
+    // Returns true to retry the failed allocation once (e.g. after evicting)
+    using failure_handler_t = std::function<bool(buddy_system&, buddy_impl::alloc_failure const&)>;
+
     buddy_system();
     ~buddy_system();
     buddy_system(memrgn_t const& rgn, unsigned align, unsigned min_cof);
     void init(memrgn_t const& rgn, unsigned align, unsigned min_cof);
     void* allocate(uint64_t size);
+    // Like allocate, but a failure is not reported (no failure handler, no failure count), e.g. for
+    // a probe of a front end which falls back to another source
+    void* try_allocate(uint64_t size);
     void deallocate(void* p);
+    void* reallocate(void* p, uint64_t size, buddy_impl::realloc_path* path = nullptr);
+    // Bytes usable from a pointer returned by allocate
+    uint64_t usable_size(void const* p) const;
+    // Returns a pointer aligned to `alignment` (a power of two), e.g. for direct I/O or SIMD buffers.
+    // The pointer has no block header; it must be freed by deallocate_aligned.
+    // buddy_compactor does not move the block.
+    void* allocate_aligned(uint64_t size, uint64_t alignment);
+    void deallocate_aligned(void* p);
+    // Returns a pointer to `size` bytes without the internal fragmentation of a single block:
+    // the best-fit block is split down to the request, its unused tail blocks go back to the free
+    // lists at once, and the blocks in use (at most one per level) are held together.
+    // At most a minimum block is wasted. The pointer must be freed by deallocate_exact.
+    // buddy_compactor does not move the blocks.
+    void* allocate_exact(uint64_t size);
+    void deallocate_exact(void* p);
+    uint64_t usable_size_exact(void const* p) const;
     buddy_block* allocate_block(uint64_t size);
+    // Like allocate_block, but a failure is not reported
+    buddy_block* try_allocate_block(uint64_t size);
     void deallocate_block(buddy_block* blk);
+    // Resizes the block in place; returns nullptr (and the block remains) if it cannot be resized in place.
+    buddy_block* resize_block(buddy_block* blk, uint64_t size, buddy_impl::realloc_path* path = nullptr);
+
+    void set_placement_policy(buddy_impl::placement_policy policy);
+
+    buddy_impl::placement_policy placement_policy() const {
+        return _placement;
+    }
+
+    void enable_lazy_coalescing(buddy_impl::lazy_coalescing_config const& cfg);
+    void disable_lazy_coalescing();
+    // Merges every lazily freed block
+    void coalesce();
+
+    // Batched APIs share splits of an ancestor block across the batch and
+    // merge freed buddies level by level in a single pass.
+    // The allocations return the number of blocks stored in `out`.
+    unsigned allocate_batch(uint64_t size, unsigned count, void** out);
+    void deallocate_batch(void* const* ptrs, unsigned count);
+    unsigned allocate_block_batch(uint64_t size, unsigned count, buddy_block** out);
+    void deallocate_block_batch(buddy_block* const* blks, unsigned count);
+
+    // Frees a pointer returned by allocate from a thread other than the owner, without a lock.
+    // The allocation must hold a pointer (the link of the inbox). The block is freed by the owner at its next allocation or by drain_remote_frees().
+    void deallocate_remote(void* p) {
+        if (p != nullptr)
+            _remote.push(p);
+    }
+
+    // Frees the blocks of deallocate_remote in a batch; returns the number of freed blocks
+    unsigned drain_remote_frees();
 
     memrgn_t const& rgn() const {
         return _rgn;
@@ -51,6 +234,54 @@ public:
         return _max_blk_size;
     }
 
+    unsigned align() const {
+        return _align;
+    }
+
+    buddy_impl::buddy_table const& table() const {
+        return _tbl;
+    }
+
+    // The size of the largest free block, or 0 (lazily freed blocks are counted unmerged)
+    uint64_t largest_free_block() const;
+
+    // May be called by any thread
+    buddy_impl::buddy_system_snapshot snapshot() const;
+
+    uint64_t allocated_size() const {
+        return static_cast<uint64_t>(_total_allocated_size);
+    }
+
+    // Callbacks run when a watermark is crossed, at the end of the allocate or free call which
+    // crossed it, so they may allocate or free (e.g. evict) on the buddy system.
+    void set_pressure_watermarks(buddy_impl::pressure_config const& cfg);
+    // Returns an id for remove_pressure_callback
+    unsigned add_pressure_callback(pressure_callback_t cb);
+    void remove_pressure_callback(unsigned id);
+
+    buddy_impl::pressure_level pressure() const {
+        return _pressure;
+    }
+
+    void set_failure_handler(failure_handler_t handler) {
+        _failure_handler = std::move(handler);
+    }
+
+    uint64_t num_failures() const {
+        return _num_failures;
+    }
+
+    buddy_impl::alloc_failure const& last_failure() const {
+        return _last_failure;
+    }
+
+#ifdef ASH_BUDDY_SYSTEM_ALLOCATION_TRACE
+    // Records the pointer APIs (allocate, deallocate, reallocate and their batches); nullptr detaches
+    void set_trace_recorder(alloc_trace_recorder* recorder) {
+        _trace = recorder;
+    }
+#endif // !ASH_BUDDY_SYSTEM_ALLOCATION_TRACE
+
 protected:
     struct routing_result {
         bool success;
@@ -62,27 +293,170 @@ protected:
     static void _split_block(buddy_block* parent, buddy_block* left, buddy_block* right, buddy_impl::buddy_table const& tbl);
 
     void _deallocate(buddy_block* block);
+    buddy_block* _allocate_block(uint64_t size);
+    template <typename Emit>
+    unsigned _allocate_batch(uint64_t size, unsigned count, Emit&& emit);
+    template <typename Emit>
+    unsigned _carve_block(buddy_block* block, uint64_t size, buddy_impl::cof_type need, unsigned count, Emit& emit);
+    template <typename Fetch>
+    void _deallocate_batch(unsigned count, Fetch&& fetch);
+
+    ASH_FORCEINLINE void _drain_remote_if_any() {
+        if (ASH_UNLIKELY(!_remote.empty()))
+            drain_remote_frees();
+    }
+
     void _cleanup();
-    buddy_block* _acquire_block(buddy_impl::blkidx_t bidx) const;
+    buddy_block* _acquire_block(buddy_impl::blkidx_t bidx);
     routing_result _create_route(buddy_impl::blkidx_t bidx);
 
+    struct level_counter {
+        std::atomic<uint64_t> num_free;
+        std::atomic<uint64_t> num_used;
+    };
+
+    // Counters have a single writer (the owner of the buddy system),
+    // so they are updated without read-modify-write instructions.
+    ASH_FORCEINLINE static void _add_counter(std::atomic<uint64_t>& c, uint64_t const delta) {
+        c.store(c.load(std::memory_order_relaxed) + delta, std::memory_order_relaxed);
+    }
+
+    ASH_FORCEINLINE static void _sub_counter(std::atomic<uint64_t>& c, uint64_t const delta) {
+        c.store(c.load(std::memory_order_relaxed) - delta, std::memory_order_relaxed);
+    }
+
+    // Inserts a free block by the placement policy; `front` is the end of the list under Mixed placement
+    ASH_FORCEINLINE void _push_free(buddy_block* block, bool const front) {
+        using buddy_impl::placement_policy;
+        buddy_impl::free_list_t& list = _flist_v[block->blkidx];
+        if (_placement == placement_policy::Lifo || (_placement == placement_policy::Mixed && front))
+            block->inv = list.emplace_front(block).node();
+        else
+            block->inv = list.emplace_back(block).node();
+        _on_free_list_insert(block->blkidx);
+        if (ASH_UNLIKELY(_placement == placement_policy::AddressOrdered))
+            _push_address(block);
+    }
+
+    buddy_block* _pop_free(buddy_impl::blkidx_t bidx);
+
+    // Address-ordered placement keeps a min-heap of addresses per block index. Entries of
+    // blocks removed from a free list are dropped when they reach the top of the heap.
+    struct address_entry {
+        void* ptr;
+        buddy_block* block;
+        uint32_t gen;
+    };
+
+    void _push_address(buddy_block* block);
+    void _rebuild_address_heaps();
+
+    // Free lists are tracked by a bitmask of non-empty block indices
+    ASH_FORCEINLINE void _on_free_list_insert(buddy_impl::blkidx_t const bidx) {
+        _nonempty_mask[bidx / 64] |= uint64_t{ 1 } << (bidx % 64);
+        _add_counter(_level_counter_v[bidx].num_free, 1);
+    }
+
+    ASH_FORCEINLINE void _on_free_list_remove(buddy_block* block) {
+        buddy_impl::blkidx_t const bidx = block->blkidx;
+        if (_flist_v[bidx].empty())
+            _nonempty_mask[bidx / 64] &= ~(uint64_t{ 1 } << (bidx % 64));
+        _sub_counter(_level_counter_v[bidx].num_free, 1);
+        if (ASH_UNLIKELY(block->lazy != 0))
+            _forget_lazy_block(block);
+        block->gen = (block->gen + 1) & ~uint32_t{ 1 }; // invalidates its address entries
+    }
+
+    bool _defer_merge(buddy_block* block);
+    void _forget_lazy_block(buddy_block* block);
+
+    void _on_block_granted(buddy_block* block, uint64_t requested);
+    void _on_block_released(buddy_block* block);
+    bool _on_alloc_failure(uint64_t size);
+
+    // Crossings are detected on every block and dispatched once the tree is consistent
+    ASH_FORCEINLINE void _dispatch_pressure_if_pending() {
+        if (ASH_UNLIKELY(_pressure_pending))
+            _dispatch_pressure();
+    }
+
+    void _dispatch_pressure();
+    void _update_pressure_bounds();
+    // Precedes a pointer of allocate_exact; the blocks in use are the last block and the left
+    // siblings of its ancestors reached from their right children, up to the top block
+    struct exact_header {
+        buddy_block* last;
+        buddy_block* top;
+    };
+
+    buddy_block* _trim_block(buddy_block* block, uint64_t size);
+    buddy_block* _grow_block(buddy_block* block, uint64_t size);
+    buddy_block* _shrink_block(buddy_block* block, uint64_t size);
+
+    // Blocks inside a fence are pinned instead of being freed until the fence is lifted
+    ASH_FORCEINLINE bool _is_fenced(buddy_block const* block) const {
+        return _fence.ptr != nullptr && block->rgn.ptr >= _fence.ptr &&
+            seek_pointer(block->rgn.ptr, block->rgn.size) <= seek_pointer(_fence.ptr, _fence.size);
+    }
+
+    void _pin_block(buddy_block* block);
+    void _set_fence(memrgn_t const& rgn);
+    void _lift_fence();
+
     memrgn_t _rgn;
     unsigned _align;
     uint64_t _max_blk_size;
     buddy_impl::free_list_t::pool_type _node_pool;
     ash::unordered_object_pool<buddy_block> _block_pool;
     buddy_impl::free_list_t* _flist_v;
+    buddy_block* _root;
+    memrgn_t _fence;
+    std::vector<buddy_block*> _fenced;
+    std::vector<unsigned> _lazy_limit_v;             // empty if lazy coalescing is disabled
+    std::vector<std::vector<buddy_block*>> _lazy_v;  // lazily freed blocks per level
+    uint64_t _lazy_size;
+    uint64_t _lazy_watermark;
+    bool _coalescing;
     bitstack _route;
+    std::vector<std::vector<buddy_block*>> _merge_v; // blocks to be merged per level
+    buddy_impl::placement_policy _placement;
+    std::vector<std::vector<address_entry>> _address_heap_v; // per block index (address-ordered placement)
     buddy_impl::buddy_system_status _status;
     buddy_impl::buddy_table _tbl;
+    buddy_impl::buddy_route_table _routes;
+    buddy_impl::block_index _aligned_index; // blocks of allocate_aligned (initialized on the first use)
+    remote_free_inbox _remote;
+    std::vector<buddy_block*> _drain_v;
+    std::vector<buddy_block*> _exact_v; // blocks of an exact allocation being freed
+    uint64_t _nonempty_mask[buddy_impl::buddy_route_table::MaskWords];
 #ifdef ASH_DEBUG_ENABLE_BUDDY_ROUTE_CORRECTNESS_CHECKING
     stack<unsigned> _route_dbg;
 #endif // !ASH_DEBUG_ENABLE_BUDDY_ROUTE_CORRECTNESS_CHECKING
     int64_t _total_allocated_size;
+    level_counter* _level_counter_v;
+    int64_t _pressure_wm[buddy_impl::NumPressureLevels]; // INT64_MAX if disabled
+    int64_t _pressure_hysteresis;
+    int64_t _pressure_up;   // the next watermark above the level
+    int64_t _pressure_down; // the watermark of the level less the hysteresis
+    buddy_impl::pressure_level _pressure;
+    bool _pressure_pending;
+    bool _in_pressure_dispatch;
+    unsigned _next_pressure_cb_id;
+    std::vector<std::pair<unsigned, pressure_callback_t>> _pressure_cb_v;
+    failure_handler_t _failure_handler;
+    uint64_t _num_failures;
+    buddy_impl::alloc_failure _last_failure;
+    std::atomic<uint64_t> _requested_size;
+    std::atomic<uint64_t> _request_hist[buddy_impl::buddy_system_snapshot::HistogramSize];
+    std::atomic<uint64_t> _realloc_count[buddy_impl::NumReallocPaths];
+#ifdef ASH_BUDDY_SYSTEM_ALLOCATION_TRACE
+    alloc_trace_recorder* _trace;
+#endif // !ASH_BUDDY_SYSTEM_ALLOCATION_TRACE
 };
 
 template<typename T = void>
 class buddy_allocator {
+    template<typename U> friend class buddy_allocator;
 public:
     using value_type = T;
     using size_type = std::size_t;
@@ -91,7 +465,7 @@ public:
     using difference_type = typename std::pointer_traits<pointer>::difference_type;
 
     explicit buddy_allocator(buddy_system& buddy) noexcept :
-        _buddy(buddy) {
+        _buddy(&buddy) {
     }
 
     ~buddy_allocator() noexcept {
@@ -99,15 +473,29 @@ public:
 
     template<typename U>
     buddy_allocator(buddy_allocator<U> const& other) noexcept :
-        _buddy(other.buddy) {
+        _buddy(other._buddy) {
     }
 
-    T* allocate(size_t size, const void* = 0) {
-        return _buddy.allocate(size);
+    T* allocate(size_t n, const void* = 0) {
+        void* p;
+        if constexpr (alignof(T) > sizeof(buddy_impl::buddy_block*))
+            p = _buddy->allocate_aligned(n * sizeof(T), alignof(T));
+        else
+            p = _buddy->allocate(n * sizeof(T));
+        if (p == nullptr)
+            throw std::bad_alloc{};
+        return static_cast<T*>(p);
     }
 
-    void deallocate(T* ptr, size_t /*size*/) {
-        _buddy.deallocate(ptr);
+    void deallocate(T* ptr, size_t /*n*/) {
+        if constexpr (alignof(T) > sizeof(buddy_impl::buddy_block*))
+            _buddy->deallocate_aligned(ptr);
+        else
+            _buddy->deallocate(ptr);
+    }
+
+    buddy_system& buddy() const noexcept {
+        return *_buddy;
     }
 
     template<typename U>
@@ -115,8 +503,18 @@ public:
         typedef buddy_allocator<U> other;
     };
 
+    template<typename U>
+    bool operator==(buddy_allocator<U> const& other) const noexcept {
+        return _buddy == other._buddy;
+    }
+
+    template<typename U>
+    bool operator!=(buddy_allocator<U> const& other) const noexcept {
+        return _buddy != other._buddy;
+    }
+
 private:
-    buddy_system& _buddy;
+    buddy_system* _buddy;
 };
 
 } // !namespace ash
@@ -1,6 +1,7 @@
 #ifndef _ASH_MEMORY_BUDDY_TABLE_H_
 #define _ASH_MEMORY_BUDDY_TABLE_H_
 #include <ash/detail/noncopyable.h>
+#include <ash/numeric.h>
 #include <stdint.h>
 
 namespace ash {
@@ -25,6 +26,29 @@ typedef struct buddy_block_propoerty {
 } blk_prop_t;
 static_assert(sizeof(buddy_block_propoerty) == 1, "a size of buddy_block_property is not 1");
 
+struct node_location {
+    cof_type cof;
+    cof_type offset; // in units of the alignment
+};
+
+// Locates a node of the implicit buddy tree whose nodes are numbered in heap order (root: 1).
+// A parent of cof c is split into a left child of cof c - c / 2 and a right child of c / 2.
+inline node_location locate_node(cof_type const root_cof, uint64_t const node) {
+    node_location loc{ root_cof, 0 };
+    unsigned const depth = log2u_nz(node);
+    for (unsigned i = depth; i > 0; --i) {
+        cof_type const left = loc.cof - loc.cof / 2;
+        if ((node >> (i - 1)) & 0x1u) {
+            loc.offset += left;
+            loc.cof /= 2;
+        }
+        else {
+            loc.cof = left;
+        }
+    }
+    return loc;
+}
+
 class buddy_table : noncopyable {
 public:
 
@@ -0,0 +1,77 @@
+#ifndef ASH_MEMORY_COMPACT_BUDDY_SYSTEM_H
+#define ASH_MEMORY_COMPACT_BUDDY_SYSTEM_H
+#include <ash/memory.h>
+#include <ash/memory/implicit_buddy_tree.h>
+#include <ash/detail/noncopyable.h>
+
+namespace ash {
+
+/*
+ * Buddy system with implicit metadata.
+ *
+ * The allocation tree is an implicit_buddy_tree, so the metadata of every potential block is
+ * a single byte of state and no block descriptor or list node is allocated. A pointer is mapped
+ * back to its node by walking down the split nodes from the root, so allocations have no header
+ * and every pointer is aligned to the alignment of the system.
+ *
+ * It serves the pointer APIs of buddy_system (no block, batch or reallocation APIs).
+ * Like buddy_system, it is not thread-safe.
+ */
+class compact_buddy_system : noncopyable {
+public:
+    constexpr static unsigned MaxTableSize = buddy_impl::implicit_buddy_tree::MaxTableSize;
+
+    compact_buddy_system();
+    ~compact_buddy_system() noexcept;
+    compact_buddy_system(memrgn_t const& rgn, unsigned align, unsigned min_cof);
+    bool init(memrgn_t const& rgn, unsigned align, unsigned min_cof);
+    void* allocate(uint64_t size);
+    void deallocate(void* p);
+    // Bytes usable from a pointer returned by allocate
+    uint64_t usable_size(void const* p) const;
+    // The size of the largest free block, or 0
+    uint64_t largest_free_block() const {
+        return _tree.largest_free_block();
+    }
+
+    memrgn_t const& rgn() const {
+        return _rgn;
+    }
+
+    uint64_t max_alloc() const {
+        return _max_blk_size;
+    }
+
+    unsigned align() const {
+        return _tree.align();
+    }
+
+    buddy_impl::buddy_table const& table() const {
+        return _tree.table();
+    }
+
+    uint64_t allocated_size() const {
+        return _allocated_size;
+    }
+
+    // Bytes of the node states (pages are zero-filled by the OS on the first touch)
+    uint64_t metadata_size() const {
+        return _num_nodes;
+    }
+
+protected:
+    void _cleanup() noexcept;
+
+    memrgn_t _rgn;
+    char* _base;
+    uint64_t _max_blk_size;
+    uint64_t _allocated_size;
+    uint64_t _num_nodes;
+    uint8_t* _states;
+    uint64_t _heads[MaxTableSize]; // free lists of the tree
+    buddy_impl::implicit_buddy_tree _tree;
+};
+
+} // !namespace ash
+
+#endif // ASH_MEMORY_COMPACT_BUDDY_SYSTEM_H
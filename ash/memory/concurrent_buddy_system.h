@@ -0,0 +1,80 @@
+#ifndef ASH_MEMORY_CONCURRENT_BUDDY_SYSTEM_H
+#define ASH_MEMORY_CONCURRENT_BUDDY_SYSTEM_H
+#include <ash/memory/buddy_system.h>
+#include <ash/detail/noncopyable.h>
+#include <atomic>
+#include <mutex>
+
+namespace ash {
+
+namespace buddy_impl {
+
+struct block_magazine;
+struct thread_block_cache;
+
+} // namespace buddy_impl
+
+/*
+ * Thread-safe front end of the buddy system.
+ *
+ * Every thread keeps a private cache (a set of magazines) of recently freed blocks
+ * for each block index of the buddy table. allocate() and deallocate() only touch
+ * the calling thread's magazine; the shared buddy system is locked when a magazine
+ * has to be refilled (empty) or flushed (full), and then a half of the magazine
+ * is moved at once.
+ *
+ * A magazine of block index i only holds blocks whose coefficient is not smaller
+ * than cof(i), so a cached block can always serve a request of its class.
+ *
+ * Cached blocks of a thread are returned to the buddy system when the thread exits,
+ * when flush_local_cache() is called, or when the front end is destroyed. A thread which
+ * finds no block in the buddy system also requests a flush of every cache, which the other
+ * threads carry out at their next allocate()/deallocate() (idle threads keep their blocks).
+ * The front end must outlive any concurrent allocate()/deallocate() call.
+ */
+class concurrent_buddy_system : noncopyable {
+    using buddy_block = buddy_impl::buddy_block;
+    using thread_block_cache = buddy_impl::thread_block_cache;
+public:
+    constexpr static unsigned DefaultMagazineSize = 32;
+
+    concurrent_buddy_system(memrgn_t const& rgn, unsigned align, unsigned min_cof, unsigned magazine_size = DefaultMagazineSize);
+    ~concurrent_buddy_system() noexcept;
+    void* allocate(uint64_t size);
+    void deallocate(void* p);
+    void flush_local_cache();
+
+    memrgn_t const& rgn() const {
+        return _buddy.rgn();
+    }
+
+    uint64_t max_alloc() const {
+        return _buddy.max_alloc();
+    }
+
+    unsigned magazine_size() const {
+        return _magazine_size;
+    }
+
+protected:
+    friend struct buddy_impl::thread_block_cache;
+
+    thread_block_cache* _local_cache();
+    thread_block_cache* _attach_local_cache();
+    void _release_cache(thread_block_cache* cache);
+    bool _refill(buddy_impl::block_magazine& mag, uint64_t size, bool report);
+    void _flush(buddy_impl::block_magazine& mag, unsigned count);
+    void _flush_all(thread_block_cache* cache);
+    void _check_flush_request(thread_block_cache* cache);
+
+    std::mutex _mtx;
+    buddy_system _buddy;
+    unsigned const _magazine_size;
+    uint64_t const _id;
+    std::atomic<uint64_t> _flush_epoch; // bumped to request a flush of every thread cache
+    thread_block_cache* _caches; // guarded by the cache registry lock
+};
+
+} // !namespace ash
+
+#endif // ASH_MEMORY_CONCURRENT_BUDDY_SYSTEM_H
@@ -0,0 +1,89 @@
+#ifndef ASH_MEMORY_HUGEPAGE_ARENA_H
+#define ASH_MEMORY_HUGEPAGE_ARENA_H
+#include <ash/memory.h>
+#include <ash/detail/noncopyable.h>
+
+namespace ash {
+
+enum class arena_page_kind {
+    Normal = 0,
+    Transparent, // transparent huge pages were advised
+    Hugetlb,     // pages of the hugetlbfs pool (MAP_HUGETLB)
+};
+
+struct hugepage_arena_config {
+    bool hugetlb = true;           // try MAP_HUGETLB first
+    bool transparent = true;       // then advise transparent huge pages
+    bool lock = false;             // mlock the arena after prefaulting
+    bool prefault = true;
+    unsigned prefault_threads = 0; // 0: the number of hardware threads
+};
+
+/*
+ * A region of huge pages for buddy_system, segregated_storage or any other user of memrgn_t.
+ *
+ * The arena is mapped with MAP_HUGETLB if the hugetlbfs pool has enough pages, otherwise it is
+ * aligned to the huge page size and advised to be backed by transparent huge pages, and with
+ * normal pages if neither is available. The size is rounded up to the page size of the arena.
+ * Pages are prefaulted by several threads at once, so page faults do not hit the first touch
+ * in the middle of a run.
+ */
+class hugepage_arena : noncopyable {
+public:
+    hugepage_arena();
+    explicit hugepage_arena(uint64_t size, hugepage_arena_config const& cfg = hugepage_arena_config{});
+    ~hugepage_arena() noexcept;
+    bool map(uint64_t size, hugepage_arena_config const& cfg = hugepage_arena_config{});
+    void unmap() noexcept;
+    void printout() const;
+
+    bool is_mapped() const {
+        return _rgn.ptr != nullptr;
+    }
+
+    memrgn_t const& rgn() const {
+        return _rgn;
+    }
+
+    void* data() const {
+        return _rgn.ptr;
+    }
+
+    uint64_t size() const {
+        return _rgn.size;
+    }
+
+    arena_page_kind page_kind() const {
+        return _kind;
+    }
+
+    uint64_t page_size() const {
+        return _page_size;
+    }
+
+    bool locked() const {
+        return _locked;
+    }
+
+    double prefault_sec() const {
+        return _prefault_sec;
+    }
+
+    // The size of the default huge page (0 if unknown)
+    static uint64_t huge_page_size();
+
+protected:
+    void _prefault(unsigned num_threads, uint64_t step);
+
+    memrgn_t _rgn;
+    void* _map_base;   // the mapping holding the region (larger than it for alignment)
+    uint64_t _map_size;
+    arena_page_kind _kind;
+    uint64_t _page_size;
+    bool _locked;
+    double _prefault_sec;
+};
+
+} // !namespace ash
+
+#endif // ASH_MEMORY_HUGEPAGE_ARENA_H
@@ -0,0 +1,107 @@
+#ifndef ASH_MEMORY_IMPLICIT_BUDDY_TREE_H
+#define ASH_MEMORY_IMPLICIT_BUDDY_TREE_H
+#include <ash/memory/buddy_table.h>
+#include <ash/detail/noncopyable.h>
+
+namespace ash {
+namespace buddy_impl {
+
+/*
+ * Allocation tree of a buddy system with implicit metadata.
+ *
+ * The tree is the implicit tree of locate_node (heap-ordered node numbers over the buddy_table
+ * geometry), so the metadata of every potential block is a single byte of state. Free lists
+ * (one per block index) are doubly linked through the free blocks themselves by offsets from
+ * the region, and tracked by a bitmask of non-empty lists. A block is found from its offset by
+ * walking down the split nodes from the root.
+ *
+ * The node states and the list heads are storage of the owner (e.g. in a mapped file), so the
+ * tree holds no pointer into the region and can be attached to a region mapped anywhere.
+ */
+class implicit_buddy_tree : noncopyable {
+public:
+    constexpr static unsigned MaskWords = 2;
+    constexpr static unsigned MaxTableSize = MaskWords * 64;
+    constexpr static uint64_t NullOffset = ~uint64_t{ 0 };
+
+    // Placed at the beginning of a free block
+    struct free_link {
+        uint64_t node;
+        uint64_t prev;
+        uint64_t next;
+    };
+
+    enum node_state : uint8_t {
+        Absent = 0, // a descendant of a free or used block
+        Free,
+        Split,
+        Used,
+    };
+
+    implicit_buddy_tree();
+    // Builds the geometry; `owner` names the allocator in the message of a too large table
+    bool init(cof_type root_cof, unsigned align, cof_type min_cof, char const* owner);
+    // states: num_nodes() bytes, heads: MaxTableSize offsets. With `reset`, the root becomes
+    // the only free block; otherwise they hold the tree of a previous attach to the region.
+    void attach(uint8_t* states, char* base, uint64_t* heads, bool reset);
+    void clear() noexcept;
+    // Returns the offset of a block holding `size` bytes (or NullOffset); `block_size` is set to the bytes of the block
+    uint64_t allocate(uint64_t size, uint64_t& block_size);
+    // Returns the bytes of the freed block, or 0 if no block in use begins at the offset
+    uint64_t deallocate(uint64_t off);
+    // Bytes of the block holding the offset
+    uint64_t block_size(uint64_t off) const;
+    // The size of the largest free block, or 0
+    uint64_t largest_free_block() const;
+
+    bool initialized() const {
+        return _tbl.size() > 0;
+    }
+
+    buddy_table const& table() const {
+        return _tbl;
+    }
+
+    unsigned align() const {
+        return _align;
+    }
+
+    uint64_t max_alloc() const {
+        return static_cast<uint64_t>(_tbl.cof(0)) * _align;
+    }
+
+    uint64_t num_nodes() const {
+        return uint64_t{ 1 } << (_tbl.max_level() + 1);
+    }
+
+protected:
+    // Nodes from the root to the node holding an offset
+    struct node_path {
+        uint64_t node;
+        level_t lv;
+        uint64_t off_v[64];  // in bytes from the region
+        cof_type cof_v[64];
+    };
+
+    free_link* _link(uint64_t const off) const {
+        return reinterpret_cast<free_link*>(_base + off);
+    }
+
+    void _walk(uint64_t off, node_path& path) const;
+    blkidx_t _blkidx(level_t lv, cof_type cof) const;
+    void _push_free(uint64_t node, uint64_t off, blkidx_t bidx);
+    void _remove_free(uint64_t off, blkidx_t bidx);
+
+    unsigned _align;
+    uint8_t* _states;
+    char* _base;
+    uint64_t* _heads;
+    blkidx_t _first_v[64]; // the first block index of each level
+    uint64_t _nonempty_mask[MaskWords];
+    buddy_table _tbl;
+};
+
+} // !namespace buddy_impl
+} // !namespace ash
+
+#endif // ASH_MEMORY_IMPLICIT_BUDDY_TREE_H
@@ -0,0 +1,155 @@
+#ifndef ASH_MEMORY_MEMORY_RESOURCE_H
+#define ASH_MEMORY_MEMORY_RESOURCE_H
+#include <ash/memory/buddy_system.h>
+#include <ash/memory/segregated_storage.h>
+#include <ash/memory/unordered_object_pool.h>
+#include <ash/detail/noncopyable.h>
+#include <memory>
+#include <memory_resource>
+#include <vector>
+
+namespace ash {
+
+/*
+ * std::pmr::memory_resource adapters of ash allocators.
+ *
+ * A resource refers to an allocator owned by the caller. Requests which an allocator cannot
+ * serve (too large, or over-aligned) go to the upstream resource, which is
+ * std::pmr::null_memory_resource() (throwing std::bad_alloc) unless given.
+ * Like the allocators, the resources are not thread-safe.
+ */
+
+class buddy_memory_resource : public std::pmr::memory_resource, noncopyable {
+public:
+    explicit buddy_memory_resource(buddy_system& buddy) noexcept :
+        _buddy(buddy) {
+    }
+
+    buddy_system& buddy() const noexcept {
+        return _buddy;
+    }
+
+protected:
+    void* do_allocate(size_t bytes, size_t alignment) override;
+    void do_deallocate(void* p, size_t bytes, size_t alignment) override;
+    bool do_is_equal(std::pmr::memory_resource const& other) const noexcept override;
+
+    buddy_system& _buddy;
+};
+
+// Serves requests of at most one block of the storage
+class segregated_storage_resource : public std::pmr::memory_resource, noncopyable {
+public:
+    explicit segregated_storage_resource(segregated_storage& storage,
+        std::pmr::memory_resource* upstream = std::pmr::null_memory_resource()) noexcept;
+
+    segregated_storage& storage() const noexcept {
+        return _storage;
+    }
+
+protected:
+    void* do_allocate(size_t bytes, size_t alignment) override;
+    void do_deallocate(void* p, size_t bytes, size_t alignment) override;
+    bool do_is_equal(std::pmr::memory_resource const& other) const noexcept override;
+
+    segregated_storage& _storage;
+    std::pmr::memory_resource* _upstream;
+    size_t _max_align; // the alignment of every block
+};
+
+// Serves requests fitting in a value of the pool
+template <typename Pool>
+class object_pool_resource : public std::pmr::memory_resource, noncopyable {
+public:
+    using pool_type = Pool;
+    using value_type = typename Pool::value_type;
+
+    explicit object_pool_resource(pool_type& pool,
+        std::pmr::memory_resource* upstream = std::pmr::null_memory_resource()) noexcept :
+        _pool(pool), _upstream(upstream) {
+    }
+
+    pool_type& pool() const noexcept {
+        return _pool;
+    }
+
+protected:
+    static bool _fits(size_t const bytes, size_t const alignment) noexcept {
+        return bytes <= sizeof(value_type) && alignment <= alignof(value_type);
+    }
+
+    void* do_allocate(size_t const bytes, size_t const alignment) override {
+        if (_fits(bytes, alignment))
+            return _pool.allocate();
+        return _upstream->allocate(bytes, alignment);
+    }
+
+    void do_deallocate(void* p, size_t const bytes, size_t const alignment) override {
+        if (_fits(bytes, alignment))
+            _pool.deallocate(static_cast<value_type*>(p));
+        else
+            _upstream->deallocate(p, bytes, alignment);
+    }
+
+    bool do_is_equal(std::pmr::memory_resource const& other) const noexcept override {
+        return this == &other;
+    }
+
+    pool_type& _pool;
+    std::pmr::memory_resource* _upstream;
+};
+
+/*
+ * Pool resource over a buddy system.
+ *
+ * Requests up to MaxSmallSize bytes are rounded up to a power-of-two size class and served
+ * by segregated storages over chunks allocated from the buddy system; larger requests go to
+ * the buddy system directly. Chunks are returned to the buddy system by release() or on
+ * destruction.
+ */
+class buddy_pool_resource : public std::pmr::memory_resource, noncopyable {
+    using buddy_block = buddy_impl::buddy_block;
+public:
+    constexpr static unsigned MinClassBits = 3;
+    constexpr static unsigned MaxClassBits = 9;
+    constexpr static unsigned NumClasses = MaxClassBits - MinClassBits + 1;
+    constexpr static size_t MaxSmallSize = size_t{ 1 } << MaxClassBits;
+
+    explicit buddy_pool_resource(buddy_system& buddy, uint64_t chunk_size = KiB(64));
+    ~buddy_pool_resource() noexcept override;
+    void release() noexcept;
+
+    buddy_system& buddy() const noexcept {
+        return _buddy;
+    }
+
+    size_t num_chunks() const noexcept;
+
+protected:
+    struct chunk {
+        buddy_block* block;
+        std::unique_ptr<segregated_storage> storage;
+    };
+
+    struct size_class {
+        std::vector<chunk> chunks;                // sorted by address
+        std::vector<segregated_storage*> available; // storages with free blocks
+    };
+
+    static unsigned _class_of(size_t bytes) noexcept;
+    void* _allocate_small(unsigned cls);
+    void _deallocate_small(unsigned cls, void* p);
+
+    void* do_allocate(size_t bytes, size_t alignment) override;
+    void do_deallocate(void* p, size_t bytes, size_t alignment) override;
+    bool do_is_equal(std::pmr::memory_resource const& other) const noexcept override;
+
+    buddy_system& _buddy;
+    uint64_t _chunk_size;
+    buddy_memory_resource _large;
+    size_class _classes[NumClasses];
+};
+
+} // !namespace ash
+
+#endif // ASH_MEMORY_MEMORY_RESOURCE_H
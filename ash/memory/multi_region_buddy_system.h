@@ -0,0 +1,72 @@
+#ifndef ASH_MEMORY_MULTI_REGION_BUDDY_SYSTEM_H
+#define ASH_MEMORY_MULTI_REGION_BUDDY_SYSTEM_H
+#include <ash/memory/buddy_system.h>
+#include <ash/detail/noncopyable.h>
+#include <functional>
+#include <memory>
+#include <vector>
+
+namespace ash {
+
+struct buddy_region_status {
+    memrgn_t rgn;
+    uint64_t max_alloc;
+    uint64_t largest_free;
+    uint64_t num_live; // live allocations
+};
+
+/*
+ * A buddy system growing by regions.
+ *
+ * Every region is managed by its own buddy_system (a root of its own buddy table), so regions
+ * of any size can be added while the allocator is in use. A request goes to the region whose
+ * largest free block is the smallest one holding the request. Regions are kept sorted by
+ * address, so a pointer is routed back to its region by a binary search.
+ * Empty regions can be handed back to their owners (or to the OS for mapped regions).
+ *
+ * Like buddy_system, the allocator is not thread-safe.
+ */
+class multi_region_buddy_system : noncopyable {
+public:
+    // Called when a region is released
+    using release_callback_t = std::function<void(memrgn_t const&)>;
+
+    multi_region_buddy_system(unsigned align, unsigned min_cof);
+    ~multi_region_buddy_system() noexcept;
+    bool add_region(memrgn_t const& rgn, release_callback_t release = nullptr);
+    // Adds a region of anonymous memory which is unmapped when the region is released
+    bool add_mapped_region(uint64_t size);
+    void* allocate(uint64_t size);
+    void deallocate(void* p);
+    // Releases empty regions except `keep` of them; returns the number of released regions
+    unsigned release_empty_regions(unsigned keep = 0);
+    std::vector<buddy_region_status> status() const;
+    uint64_t max_alloc() const;
+
+    size_t num_regions() const {
+        return _regions.size();
+    }
+
+    unsigned align() const {
+        return _align;
+    }
+
+protected:
+    struct region {
+        memrgn_t rgn;
+        std::unique_ptr<buddy_system> buddy;
+        release_callback_t release;
+        uint64_t num_live;
+    };
+
+    region* _find(void const* p) const;
+    static void _release(region& r);
+
+    unsigned _align;
+    unsigned _min_cof;
+    std::vector<std::unique_ptr<region>> _regions; // sorted by address
+};
+
+} // !namespace ash
+
+#endif // ASH_MEMORY_MULTI_REGION_BUDDY_SYSTEM_H
@@ -0,0 +1,85 @@
+#ifndef ASH_MEMORY_NUMA_BUDDY_ARENA_H
+#define ASH_MEMORY_NUMA_BUDDY_ARENA_H
+#include <ash/memory/buddy_system.h>
+#include <ash/detail/noncopyable.h>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace ash {
+
+struct numa_node_info {
+    unsigned id;
+    std::vector<unsigned> cpus;
+    std::vector<unsigned> distance; // distances to the other nodes (indexed by node id)
+};
+
+// Discovers NUMA nodes from /sys/devices/system/node.
+// A single node holding every online cpu is reported if the topology is not available.
+std::vector<numa_node_info> discover_numa_topology();
+
+struct numa_arena_status {
+    unsigned node;
+    uint64_t capacity;
+    uint64_t allocated;        // bytes of blocks handed out by the arena
+    uint64_t num_allocated;    // live allocations
+    uint64_t num_remote;       // allocations served for threads of other nodes
+    uint64_t num_exhausted;    // local requests which fell back to the other nodes
+
+    double occupancy() const {
+        return capacity > 0 ? static_cast<double>(allocated) / static_cast<double>(capacity) : 0.0;
+    }
+};
+
+/*
+ * One buddy system per NUMA node over a node-local region.
+ * Requests go to the arena of the calling thread's node first, and then to the other
+ * arenas in the order of the node distance when the local arena runs out.
+ */
+class numa_buddy_arena : noncopyable {
+public:
+    numa_buddy_arena(uint64_t size_per_node, unsigned align, unsigned min_cof);
+    numa_buddy_arena(std::vector<numa_node_info> const& nodes, uint64_t size_per_node, unsigned align, unsigned min_cof);
+    ~numa_buddy_arena() noexcept;
+    void* allocate(uint64_t size);
+    void* allocate_on(unsigned node, uint64_t size);
+    void deallocate(void* p);
+    unsigned local_node() const;
+    numa_arena_status status(unsigned node) const;
+    std::vector<numa_arena_status> status() const;
+
+    unsigned num_nodes() const {
+        return static_cast<unsigned>(_arenas.size());
+    }
+
+    unsigned node_id(unsigned node) const {
+        return _arenas[node]->id;
+    }
+
+protected:
+    struct arena {
+        unsigned id;
+        memrgn_t rgn;
+        bool mapped;
+        std::mutex mtx;
+        buddy_system buddy;
+        std::vector<unsigned> fallback; // the other arenas sorted by distance
+        std::atomic<uint64_t> allocated;
+        std::atomic<uint64_t> num_allocated;
+        std::atomic<uint64_t> num_remote;
+        std::atomic<uint64_t> num_exhausted;
+    };
+
+    static memrgn_t _map_local_region(unsigned node_id, uint64_t size, bool* mapped);
+    static void _unmap_region(memrgn_t const& rgn, bool mapped);
+    void* _allocate_from(arena& a, uint64_t size);
+    arena* _lookup(void* p) const;
+
+    std::vector<std::unique_ptr<arena>> _arenas;
+    std::vector<int> _cpu_to_arena;
+};
+
+} // !namespace ash
+
+#endif // ASH_MEMORY_NUMA_BUDDY_ARENA_H
@@ -0,0 +1,90 @@
+#ifndef ASH_MEMORY_PERSISTENT_BUDDY_HEAP_H
+#define ASH_MEMORY_PERSISTENT_BUDDY_HEAP_H
+#include <ash/memory.h>
+#include <ash/memory/implicit_buddy_tree.h>
+#include <ash/detail/noncopyable.h>
+
+namespace ash {
+
+/*
+ * Buddy heap in a memory-mapped file.
+ *
+ * File layout
+ * +--------+--------------------------------+------------------------------+
+ * | header | node states (1 byte per node)  | data region (page aligned)   |
+ * +--------+--------------------------------+------------------------------+
+ * The allocation tree is an implicit_buddy_tree, so it is a byte array of node states, and
+ * free lists (one per block index of buddy_table) are doubly linked through the free blocks
+ * themselves by data offsets; the file does not hold any pointer and can be mapped at any
+ * address.
+ *
+ * Allocations are identified by handles (offsets into the data region). A handle stored in
+ * a root slot or inside another allocation stays valid after the heap is closed and
+ * reopened, so a working set is reused by open() without being reloaded; pages are read
+ * on demand by the page cache.
+ *
+ * The heap is not crash-consistent: open() refuses a file which was not closed.
+ */
+class persistent_buddy_heap : noncopyable {
+public:
+    using handle_t = uint64_t;
+    constexpr static handle_t NullHandle = buddy_impl::implicit_buddy_tree::NullOffset;
+    constexpr static unsigned NumRoots = 16;
+    constexpr static unsigned MaxTableSize = buddy_impl::implicit_buddy_tree::MaxTableSize;
+
+    persistent_buddy_heap();
+    ~persistent_buddy_heap() noexcept;
+    bool create(char const* path, uint64_t capacity, unsigned align, unsigned min_cof);
+    bool open(char const* path);
+    void close() noexcept;
+    bool flush();
+    handle_t allocate(uint64_t size);
+    void deallocate(handle_t h);
+    void set_root(unsigned slot, handle_t h);
+    handle_t root(unsigned slot) const;
+
+    bool is_open() const {
+        return _header != nullptr;
+    }
+
+    void* pointer(handle_t const h) const {
+        return h != NullHandle ? _data + h : nullptr;
+    }
+
+    handle_t handle(void const* p) const {
+        return p != nullptr ? static_cast<handle_t>(static_cast<char const*>(p) - _data) : NullHandle;
+    }
+
+    memrgn_t rgn() const {
+        return memrgn_t{ _data, _data_size };
+    }
+
+    uint64_t max_alloc() const {
+        return _data_size;
+    }
+
+    uint64_t allocated_size() const;
+
+    buddy_impl::buddy_table const& table() const {
+        return _tree.table();
+    }
+
+protected:
+    struct heap_header;
+
+    bool _map(char const* path, bool create, uint64_t file_size);
+    void _unmap() noexcept;
+    bool _init_geometry(buddy_impl::cof_type root_cof, unsigned align, unsigned min_cof);
+
+    int _fd;
+    uint64_t _file_size;
+    heap_header* _header;
+    uint8_t* _states;
+    char* _data;
+    uint64_t _data_size;
+    buddy_impl::implicit_buddy_tree _tree; // node states and free lists live in the file
+};
+
+} // !namespace ash
+
+#endif // ASH_MEMORY_PERSISTENT_BUDDY_HEAP_H
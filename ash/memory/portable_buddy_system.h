@@ -1,10 +1,12 @@
 #ifndef ASH_MEMORY_PORTABLE_BUDDY_SYSTEM_H
 #define ASH_MEMORY_PORTABLE_BUDDY_SYSTEM_H
 #include <ash/memory/buddy_system.h>
-#include <unordered_map>
+#include <ash/memory/buddy_block_index.h>
 
 namespace ash {
 
+// Header-free buddy system; returned pointers are the block addresses,
+// and blocks are found by an address-to-block index on deallocation.
 class portable_buddy_system {
 public:
     portable_buddy_system() = default;
@@ -12,6 +14,7 @@ public:
     void  init(memrgn_t const& rgn, unsigned align, unsigned min_cof);
     void* allocate(uint64_t size);
     void  deallocate(void* p);
+    uint64_t usable_size(void const* p) const;
 
     memrgn_t const& rgn() const {
         return buddy.rgn();
@@ -20,8 +23,12 @@ public:
         return buddy.max_alloc();
     }
 
+    buddy_impl::buddy_system_snapshot snapshot() const {
+        return buddy.snapshot();
+    }
+
 protected:
-    std::unordered_map<void*, buddy_impl::buddy_block*> hashmap;
+    buddy_impl::block_index index;
     buddy_system buddy;
 };
 
@@ -0,0 +1,101 @@
+#ifndef ASH_MEMORY_QUOTA_BUDDY_SYSTEM_H
+#define ASH_MEMORY_QUOTA_BUDDY_SYSTEM_H
+#include <ash/memory/buddy_system.h>
+#include <ash/detail/noncopyable.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace ash {
+
+enum class quota_overflow {
+    Fail = 0, // an allocation beyond the quota returns nullptr at once
+    Wait,     // an allocation beyond the quota waits for frees (up to the timeout)
+};
+
+struct quota_account_config {
+    uint64_t reserved = 0;                               // bytes kept for the account
+    uint64_t cap = std::numeric_limits<uint64_t>::max(); // bytes the account may hold
+    quota_overflow overflow = quota_overflow::Fail;
+    std::chrono::milliseconds timeout{ 1000 };           // of quota_overflow::Wait
+};
+
+struct quota_account_status {
+    std::string name;
+    uint64_t reserved;
+    uint64_t cap;
+    uint64_t used;       // bytes of the blocks held
+    uint64_t peak;
+    uint64_t num_failures;
+    uint64_t num_waits;
+};
+
+/*
+ * A buddy system shared by accounts with quotas.
+ *
+ * Every allocation is charged to an account by the bytes of its block and credited when
+ * freed, so the account must be given to deallocate as well. An account holds at most its
+ * cap, and bytes reserved for the other accounts are not lent to it: an account may grow
+ * beyond its reservation only while the unreserved bytes of the buddy system suffice.
+ * Reservations are counted in bytes, so a fragmented buddy system may still fail a request
+ * within them.
+ *
+ * Calls are serialized by a mutex; used() reads the usage of an account without the lock.
+ */
+class quota_buddy_system : noncopyable {
+public:
+    constexpr static unsigned NoAccount = std::numeric_limits<unsigned>::max();
+
+    quota_buddy_system(memrgn_t const& rgn, unsigned align, unsigned min_cof);
+    ~quota_buddy_system() noexcept;
+    // Returns the id of a new account, or NoAccount if the reservations would exceed the capacity
+    unsigned add_account(char const* name, quota_account_config const& cfg = quota_account_config{});
+    unsigned find_account(char const* name) const;
+    void* allocate(unsigned account, uint64_t size);
+    void deallocate(unsigned account, void* p);
+    quota_account_status status(unsigned account) const;
+
+    uint64_t used(unsigned account) const {
+        return _accounts[account]->used.load(std::memory_order_relaxed);
+    }
+
+    size_t num_accounts() const {
+        return _num_accounts.load(std::memory_order_acquire);
+    }
+
+    uint64_t capacity() const {
+        return _buddy.max_alloc();
+    }
+
+protected:
+    struct account {
+        std::string name;
+        quota_account_config cfg;
+        std::atomic<uint64_t> used;
+        uint64_t peak;
+        uint64_t num_failures;
+        uint64_t num_waits;
+    };
+
+    constexpr static unsigned MaxAccounts = 64;
+
+    uint64_t _charge_of(uint64_t size) const;
+    bool _admits(account const& a, uint64_t charge) const;
+
+    mutable std::mutex _mtx;
+    std::condition_variable _credited;
+    buddy_system _buddy;
+    std::unique_ptr<account> _accounts[MaxAccounts]; // never moved, so used() needs no lock
+    std::atomic<size_t> _num_accounts;
+    uint64_t _charged;        // bytes charged to every account
+    uint64_t _unused_reserve; // bytes reserved but not used, over every account
+};
+
+} // !namespace ash
+
+#endif // ASH_MEMORY_QUOTA_BUDDY_SYSTEM_H
@@ -0,0 +1,54 @@
+#ifndef ASH_MEMORY_REMOTE_FREE_INBOX_H
+#define ASH_MEMORY_REMOTE_FREE_INBOX_H
+#include <ash/config.h>
+#include <ash/detail/noncopyable.h>
+#include <atomic>
+
+namespace ash {
+
+/*
+ * Pointers freed by threads other than the owner of an allocator.
+ *
+ * Any thread pushes a freed pointer with a single compare-and-swap; the link to the next
+ * pointer is written into the freed memory, so it must hold a pointer. Only the owner takes
+ * pointers back, and it takes all of them at once, so a pushed node is never popped alone
+ * and the stack has no ABA problem.
+ */
+class remote_free_inbox : noncopyable {
+public:
+    remote_free_inbox() noexcept :
+        _head(nullptr) {
+    }
+
+    ASH_FORCEINLINE void push(void* p) noexcept {
+        node* const n = static_cast<node*>(p);
+        node* head = _head.load(std::memory_order_relaxed);
+        do {
+            n->next = head;
+        } while (!_head.compare_exchange_weak(head, n, std::memory_order_release, std::memory_order_relaxed));
+    }
+
+    ASH_FORCEINLINE bool empty() const noexcept {
+        return _head.load(std::memory_order_relaxed) == nullptr;
+    }
+
+    // Owner only; returns the last pushed pointer, and the others are reached by next()
+    ASH_FORCEINLINE void* take_all() noexcept {
+        return _head.exchange(nullptr, std::memory_order_acquire);
+    }
+
+    ASH_FORCEINLINE static void* next(void* p) noexcept {
+        return static_cast<node*>(p)->next;
+    }
+
+protected:
+    struct node {
+        node* next;
+    };
+
+    std::atomic<node*> _head;
+};
+
+} // !namespace ash
+
+#endif // ASH_MEMORY_REMOTE_FREE_INBOX_H
@@ -2,21 +2,30 @@
 #define ASH_MEMORY_SEGREGATED_STORAGE_H
 #include <ash/config.h>
 #include <ash/detail/noncopyable.h>
-#include <vector>
 #include <mutex>
 
 namespace ash {
 
+/*
+ * Blocks of a fixed size in a buffer.
+ *
+ * Freed blocks are linked through their first word, so a block holds at least a pointer and
+ * no metadata is kept outside the buffer. Blocks never handed out are taken from the end of
+ * the used part by a bump pointer, so construction and reset() take constant time and
+ * untouched blocks stay untouched.
+ * size() is the number of free blocks: empty() has no free block, and full() has every block free.
+ */
 class segregated_storage final : noncopyable {
 public:
     segregated_storage(void* preallocated, size_t bufsize, size_t block_size);
     void* allocate();
     void deallocate(void* p);
     void reset();
+    // A fraction of the blocks in use
     double fill_rate() const;
 
     bool empty() const {
-        return _free_list.empty();
+        return _num_free == 0;
     }
 
     bool full() const {
@@ -24,7 +33,7 @@ public:
     }
 
     size_t size() const {
-        return _free_list.size();
+        return _num_free;
     }
 
     void* const buffer;
@@ -33,7 +42,14 @@ public:
     uint64_t const capacity;
 
 private:
-    std::vector<void*> _free_list;
+    struct free_block {
+        free_block* next;
+    };
+
+    free_block* _free_list; // blocks freed after handed out
+    char* _bump;            // the first block never handed out
+    char* _end;             // the end of the last block
+    size_t _num_free;
 };
 
 template <typename Mutex>
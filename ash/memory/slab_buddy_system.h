@@ -0,0 +1,121 @@
+#ifndef ASH_MEMORY_SLAB_BUDDY_SYSTEM_H
+#define ASH_MEMORY_SLAB_BUDDY_SYSTEM_H
+#include <ash/memory/buddy_system.h>
+#include <ash/memory/segregated_storage.h>
+#include <ash/detail/noncopyable.h>
+#include <vector>
+
+namespace ash {
+
+struct slab_buddy_config {
+    uint64_t max_small = KiB(4);  // larger requests go to the buddy system
+    uint64_t slab_size = KiB(64); // raised to hold MinChunksPerSlab chunks of the largest class
+};
+
+/*
+ * Slabs of size classes on a buddy system.
+ *
+ * Requests up to max_small bytes are served by a segregated_storage of their size class, which
+ * lives at the beginning of a buddy block (a slab) and carves the rest of the block into chunks.
+ * Classes are multiples of 16 bytes up to 128 bytes, then four per power of two, so a small
+ * request costs its chunk instead of a minimum block and a block descriptor, and it does not
+ * walk the route of the buddy system. Larger requests go to the buddy system directly.
+ *
+ * Every pointer is preceded by a word: the block of buddy_system::allocate, or the slab of a
+ * chunk tagged by its lowest bit, so deallocate needs no size. A slab whose chunks are all free
+ * is returned to the buddy system at once, except one spare slab per class.
+ * Unlike buddy_pool_resource, frees are unsized and slabs do not outlive their chunks.
+ * Slabs are never moved by a buddy_compactor over buddy().
+ *
+ * Like buddy_system, it is not thread-safe.
+ */
+class slab_buddy_system : noncopyable {
+public:
+    constexpr static unsigned MinChunksPerSlab = 8;
+    constexpr static uint64_t ClassGranularity = 16;
+
+    slab_buddy_system();
+    ~slab_buddy_system() noexcept;
+    slab_buddy_system(memrgn_t const& rgn, unsigned align, unsigned min_cof, slab_buddy_config const& cfg = slab_buddy_config{});
+    bool init(memrgn_t const& rgn, unsigned align, unsigned min_cof, slab_buddy_config const& cfg = slab_buddy_config{});
+    void* allocate(uint64_t size);
+    void deallocate(void* p);
+    // Bytes usable from a pointer returned by allocate
+    uint64_t usable_size(void const* p) const;
+    // Returns the spare slabs to the buddy system; returns the number of released slabs
+    unsigned release_empty_slabs();
+
+    // Large requests and the slabs themselves
+    buddy_system& buddy() {
+        return _buddy;
+    }
+
+    buddy_system const& buddy() const {
+        return _buddy;
+    }
+
+    uint64_t max_small() const {
+        return _max_small;
+    }
+
+    uint64_t slab_size() const {
+        return _slab_size;
+    }
+
+    unsigned num_size_classes() const {
+        return static_cast<unsigned>(_class_size_v.size());
+    }
+
+    // Bytes of a chunk of the class (including the word before the pointer)
+    uint64_t size_class(unsigned cls) const {
+        return _class_size_v[cls];
+    }
+
+    size_t num_slabs() const {
+        return _num_slabs;
+    }
+
+protected:
+    // Placed at the beginning of a slab; chunks follow it
+    struct slab {
+        slab() = delete;
+        segregated_storage storage;
+        buddy_impl::buddy_block* block;
+        slab* prev;
+        slab* next;
+        unsigned cls;
+        bool listed; // in the list of slabs with free chunks
+    };
+
+    struct size_class_state {
+        slab* partial; // slabs with free chunks
+        slab* spare;   // an empty slab kept for the next one
+    };
+
+    constexpr static uintptr_t SlabTag = 0x1u;
+    constexpr static uint64_t HeaderSize = sizeof(uintptr_t);
+
+    ASH_FORCEINLINE unsigned _class_of(uint64_t const size) const {
+        return _class_of_v[(size + HeaderSize + ClassGranularity - 1) / ClassGranularity];
+    }
+
+    void* _allocate_small(unsigned cls);
+    void _deallocate_small(slab* s, void* chunk);
+    slab* _create_slab(unsigned cls);
+    void _destroy_slab(slab* s);
+    void _link(slab* s);
+    void _unlink(slab* s);
+    void _cleanup() noexcept;
+
+    buddy_system _buddy;
+    uint64_t _max_small;
+    uint64_t _slab_size;
+    size_t _num_slabs;
+    std::vector<uint64_t> _class_size_v;
+    std::vector<uint8_t> _class_of_v;       // indexed by chunk bytes / ClassGranularity (rounded up)
+    std::vector<size_class_state> _class_v;
+};
+
+} // !namespace ash
+
+#endif // ASH_MEMORY_SLAB_BUDDY_SYSTEM_H
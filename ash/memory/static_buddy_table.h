@@ -0,0 +1,172 @@
+#ifndef ASH_MEMORY_STATIC_BUDDY_TABLE_H
+#define ASH_MEMORY_STATIC_BUDDY_TABLE_H
+#include <ash/memory/buddy_table.h>
+#include <ash/config/compiler.h>
+#include <assert.h>
+
+namespace ash {
+namespace buddy_impl {
+
+/*
+ * Compile-time buddy table of a fixed pool geometry.
+ *
+ * The levels, coefficients and properties are the same as buddy_table(RootCof, Align, MinCof),
+ * but they are computed by constant evaluation and stored in static constexpr arrays.
+ * best_fit is a single load from a direct table indexed by the coefficient of a request
+ * for coefficients up to DirectCofs; larger requests start from a per-octave table and
+ * step forward at most a few entries.
+ */
+template <cof_type RootCof, unsigned Align, cof_type MinCof, cof_type DirectCofs = 4096>
+class static_buddy_table {
+    static_assert(RootCof > 0, "a root coefficient must be positive");
+    static_assert(MinCof > 0, "a minimum coefficient must be positive");
+    static_assert(Align % 2 == 0, "an alignment must be even");
+
+    struct _size_info {
+        level_t tbl_size;
+        level_t buddy_lv;
+    };
+
+    // Same as get_buddy_table_size_info
+    static constexpr _size_info _get_size_info() {
+        cof_type linear_bound = RootCof;
+        while (!(linear_bound & 0x1u) && linear_bound > MinCof)
+            linear_bound /= 2;
+        unsigned linear_depth = 1;
+        for (cof_type q = RootCof / linear_bound; q > 1; q /= 2)
+            linear_depth += 1;
+        if (linear_bound <= MinCof)
+            return _size_info{ linear_depth, linear_depth };
+        unsigned binary_depth = 0;
+        for (cof_type odd = linear_bound;;) {
+            cof_type const q = odd / 2;
+            odd = (q & 0x1u) ? q : q + 1;
+            if (q < MinCof)
+                break;
+            binary_depth += 1;
+        }
+        return _size_info{ linear_depth + binary_depth * 2, linear_depth + binary_depth };
+    }
+
+public:
+    constexpr static unsigned Size = _get_size_info().tbl_size;
+    constexpr static cof_type DirectLimit = DirectCofs < RootCof ? DirectCofs : RootCof;
+    static_assert(Size <= 0xFF, "a block index does not fit into the direct lookup table");
+
+private:
+    struct _tables {
+        level_t level_v[Size];
+        cof_type cof_v[Size];
+        blk_prop_t prof_v[Size];
+        unsigned char direct_v[DirectLimit + 1]; // coefficient -> block index
+        unsigned char octave_v[65];              // k -> block index of the best fit of 2^k
+    };
+
+    // Same as buddy_table::_init_properties, followed by the lookup tables
+    static constexpr _tables _build() {
+        _tables t{};
+        cof_type n = RootCof;
+        t.level_v[0] = 0;
+        t.cof_v[0] = n;
+        t.prof_v[0].flags = UniqueBuddyBlock;
+        blkidx_t i = 1;
+        while (i < Size && !(n & 0x1u)) {
+            t.level_v[i] = i;
+            t.cof_v[i] = n / 2;
+            t.prof_v[i].flags = UniqueBuddyBlock;
+            t.prof_v[i].dist = 1;
+            n /= 2;
+            i += 1;
+        }
+        if (i < Size) {
+            level_t lv = i;
+            blkidx_t const linear_size = i;
+            bool a1b3_pattern = false;
+            while (i + 1u < Size) {
+                cof_type const r = n / 2;
+                cof_type const l = r + 1;
+                t.level_v[i] = t.level_v[i + 1] = lv;
+                t.cof_v[i] = l;
+                t.cof_v[i + 1] = r;
+                if (a1b3_pattern) {
+                    t.prof_v[i].flags = RareBuddyBlock | A1B3Pattern;
+                    t.prof_v[i + 1].flags = FrequentBuddyBlock | A1B3Pattern;
+                }
+                else {
+                    t.prof_v[i].flags = FrequentBuddyBlock | A3B1Pattern;
+                    t.prof_v[i + 1].flags = RareBuddyBlock | A3B1Pattern;
+                }
+                t.prof_v[i].dist = 2;
+                t.prof_v[i + 1].dist = 3;
+                t.prof_v[i + 1].offset = 1;
+                a1b3_pattern = l & 0x1u;
+                n = a1b3_pattern ? l : r;
+                i += 2;
+                lv += 1;
+            }
+            t.prof_v[linear_size].dist = 1;
+            t.prof_v[linear_size + 1].dist = 2;
+            t.prof_v[linear_size].flags = t.prof_v[linear_size + 1].flags = RareBuddyBlock | A3B1Pattern;
+        }
+
+        // The best fit of a coefficient c is the last block index whose coefficient is not less than c
+        blkidx_t fit = Size - 1;
+        for (cof_type c = 0; c <= DirectLimit; ++c) {
+            while (t.cof_v[fit] < c)
+                fit -= 1;
+            t.direct_v[c] = static_cast<unsigned char>(fit);
+        }
+        fit = Size - 1;
+        for (unsigned k = 0; k < 65; ++k) {
+            cof_type const c = k < 63 ? cof_type{ 1 } << k : RootCof;
+            while (fit > 0 && t.cof_v[fit] < c)
+                fit -= 1;
+            t.octave_v[k] = static_cast<unsigned char>(fit);
+        }
+        return t;
+    }
+
+    constexpr static _tables _t = _build();
+
+public:
+    static constexpr unsigned align() {
+        return Align;
+    }
+
+    static constexpr unsigned size() {
+        return Size;
+    }
+
+    static constexpr level_t max_level() {
+        return _t.level_v[Size - 1];
+    }
+
+    static constexpr level_t level(blkidx_t const bidx) {
+        return _t.level_v[bidx];
+    }
+
+    static constexpr cof_type cof(blkidx_t const bidx) {
+        return _t.cof_v[bidx];
+    }
+
+    static constexpr blk_prop_t const& property(blkidx_t const bidx) {
+        return _t.prof_v[bidx];
+    }
+
+    static ASH_FORCEINLINE blkidx_t best_fit(uint64_t const block_size) {
+        assert(block_size <= static_cast<uint64_t>(RootCof) * Align);
+        uint64_t const find_cof = (block_size + Align - 1) / Align;
+        if (ASH_LIKELY(find_cof <= static_cast<uint64_t>(DirectLimit)))
+            return _t.direct_v[find_cof];
+        // find_cof is in (2^(k-1), 2^k], so the best fit of 2^k is a fit and the best fit is a few entries further
+        blkidx_t bidx = _t.octave_v[64 - count_leading_zeros(find_cof - 1)];
+        while (bidx + 1 < Size && static_cast<uint64_t>(_t.cof_v[bidx + 1]) >= find_cof)
+            bidx += 1;
+        return bidx;
+    }
+};
+
+} // !namespace buddy_impl
+} // !namespace ash
+
+#endif // ASH_MEMORY_STATIC_BUDDY_TABLE_H
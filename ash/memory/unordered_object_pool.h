@@ -1,6 +1,7 @@
 #ifndef ASH_MEMORY_UNORDERED_OBJECT_POOL_H
 #define ASH_MEMORY_UNORDERED_OBJECT_POOL_H
 #include <ash/memory/segregated_storage.h>
+#include <ash/memory/remote_free_inbox.h>
 #include <ash/numeric.h>
 #include <stack>
 #include <assert.h>
@@ -24,6 +25,16 @@ public:
     void deallocate(value_type* p);
     void reserve(size_t required);
 
+    // Any thread may free a value by deallocate_remote() without a lock;
+    // the owner frees such values at its next allocation or by drain_remote_frees().
+    ASH_FORCEINLINE void deallocate_remote(value_type* p) noexcept {
+        static_assert(sizeof(value_type) >= sizeof(void*), "A value must hold the link of the remote-free inbox");
+        if (p != nullptr)
+            _remote.push(p);
+    }
+
+    size_t drain_remote_frees();
+
     ASH_FORCEINLINE size_t num_clusters() const {
         return _num_nodes;
     }
@@ -37,12 +48,13 @@ protected:
         void* key;
         value_type value;
     };
+    constexpr static size_t value_offset = aligned_size(sizeof(void*), alignof(value_type)); // of block_type::value
     constexpr static size_t cluster_region_size = sizeof(block_type) * cluster_size;
     using cluster_t = segregated_storage;
 
     struct cluster_node {
         cluster_node() = delete;
-        char buffer[cluster_region_size];
+        alignas(block_type) char buffer[cluster_region_size];
         cluster_t cluster;
         cluster_node* next;
         cluster_node* prev;
@@ -96,6 +108,7 @@ protected:
     node_alloc_t _node_alloc;
     node_stack_t _node_stack;
     cluster_node* _curr;
+    remote_free_inbox _remote;
 };
 
 template <typename ValueType, size_t ClusterSize, typename Allocator>
@@ -111,6 +124,7 @@ unordered_object_pool<ValueType, ClusterSize, Allocator>::unordered_object_pool(
 
 template <typename ValueType, size_t ClusterSize, typename Allocator>
 unordered_object_pool<ValueType, ClusterSize, Allocator>::~unordered_object_pool() noexcept {
+    drain_remote_frees();
 #ifdef MIXX_DEBUG_ENABLE_OBJECT_LEAK_DETECTION
     assert(_curr->prev == nullptr);
     assert(_curr->next == nullptr);
@@ -142,6 +156,9 @@ typename unordered_object_pool<ValueType, ClusterSize, Allocator>::value_type* u
         return &blk->value;
     };
 
+    if (ASH_UNLIKELY(!_remote.empty()))
+        drain_remote_frees();
+
     // Try to allocate a block from the current cluster
     {
         block_type* blk = static_cast<block_type*>(_curr->cluster.allocate());
@@ -190,20 +207,34 @@ void unordered_object_pool<ValueType, ClusterSize, Allocator>::destroy(value_typ
 
 template <typename ValueType, size_t ClusterSize, typename Allocator>
 void unordered_object_pool<ValueType, ClusterSize, Allocator>::deallocate(value_type* p) {
-    block_type* blk = reinterpret_cast<block_type*>(reinterpret_cast<char*>(p) - sizeof(void*));
+    block_type* blk = reinterpret_cast<block_type*>(reinterpret_cast<char*>(p) - value_offset);
     cluster_node* node = static_cast<cluster_node*>(blk->key);
     node->cluster.deallocate(blk);
     if (node == _curr)
         return;
     if (node->stacked)
         return;
-    if (node->cluster.fill_rate() >= recycle_factor) {
+    // A cluster whose free blocks reach the recycle factor is stacked for reuse
+    if (node->cluster.fill_rate() <= 1.0 - recycle_factor) {
         _detach_node(node);
         node->stacked = true;
         _node_stack.push(node);
     }
 }
 
+template <typename ValueType, size_t ClusterSize, typename Allocator>
+size_t unordered_object_pool<ValueType, ClusterSize, Allocator>::drain_remote_frees() {
+    size_t count = 0;
+    void* p = _remote.take_all();
+    while (p != nullptr) {
+        void* next = remote_free_inbox::next(p);
+        deallocate(static_cast<value_type*>(p));
+        p = next;
+        count += 1;
+    }
+    return count;
+}
+
 template <typename ValueType, size_t ClusterSize, typename Allocator>
 void unordered_object_pool<ValueType, ClusterSize, Allocator>::reserve(size_t required) {
     if (required <= _capacity)
@@ -4,6 +4,9 @@
 #include <type_traits>
 #include <stdint.h>
 #include <stddef.h>
+#if defined(ASH_TOOLCHAIN_MSVC)
+#include <intrin.h>
+#endif
 
 namespace ash {
 
@@ -170,6 +173,31 @@ inline uint64_t log2u(uint64_t v) {
     return r;
 }
 
+// Note that the results are undefined if v is zero
+ASH_FORCEINLINE unsigned count_leading_zeros(uint64_t const v) {
+#if defined(ASH_TOOLCHAIN_MSVC)
+    unsigned long r;
+    _BitScanReverse64(&r, v);
+    return 63u - static_cast<unsigned>(r);
+#else
+    return static_cast<unsigned>(__builtin_clzll(v));
+#endif
+}
+
+ASH_FORCEINLINE unsigned count_trailing_zeros(uint64_t const v) {
+#if defined(ASH_TOOLCHAIN_MSVC)
+    unsigned long r;
+    _BitScanForward64(&r, v);
+    return static_cast<unsigned>(r);
+#else
+    return static_cast<unsigned>(__builtin_ctzll(v));
+#endif
+}
+
+ASH_FORCEINLINE unsigned log2u_nz(uint64_t const v) {
+    return 63u - count_leading_zeros(v);
+}
+
 inline unsigned log2u_nb(unsigned v) {
     unsigned r = (v > 0xFFFF) << 4; v >>= r;
     unsigned shift = (v > 0xFF) << 3; v >>= shift; r |= shift;
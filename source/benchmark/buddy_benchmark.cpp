@@ -0,0 +1,479 @@
+#include <ash/benchmark/buddy_benchmark.h>
+#include <ash/memory/buddy_system.h>
+#include <ash/memory/compact_buddy_system.h>
+#include <ash/memory/concurrent_buddy_system.h>
+#include <ash/memory/raii_buffer.h>
+#include <ash/memory/slab_buddy_system.h>
+#include <ash/memory/static_buddy_table.h>
+#include <ash/stop_watch.h>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <iomanip>
+#include <mutex>
+#include <random>
+#include <thread>
+
+#if defined(ASH_ENV_UNIX)
+#include <sys/mman.h>
+#endif
+
+namespace ash {
+
+namespace {
+
+// Every thread keeps a ring of `window` live allocations and replaces the oldest one per operation.
+template <typename AllocFn, typename FreeFn>
+throughput_sample run_scaling_step(buddy_scaling_config const& cfg, unsigned const num_threads, AllocFn&& alloc_fn, FreeFn&& free_fn) {
+    std::atomic<unsigned> ready{ 0 };
+    std::atomic<bool> start{ false };
+    std::atomic<uint64_t> failures{ 0 };
+    std::vector<std::thread> threads;
+    threads.reserve(num_threads);
+
+    for (unsigned t = 0; t < num_threads; ++t) {
+        threads.emplace_back([&, t]() {
+            std::minstd_rand rng{ t + 1 };
+            std::uniform_int_distribution<uint64_t> dist{ cfg.min_request, cfg.max_request };
+            std::vector<void*> ring(cfg.window, nullptr);
+            uint64_t local_failures = 0;
+            ready.fetch_add(1);
+            while (!start.load(std::memory_order_acquire)) {
+            }
+            for (uint64_t i = 0; i < cfg.ops_per_thread; ++i) {
+                void*& slot = ring[i % cfg.window];
+                free_fn(slot);
+                slot = alloc_fn(dist(rng));
+                local_failures += (slot == nullptr);
+            }
+            for (void* p : ring)
+                free_fn(p);
+            failures.fetch_add(local_failures);
+        });
+    }
+
+    while (ready.load() != num_threads) {
+    }
+    stop_watch sw;
+    start.store(true, std::memory_order_release);
+    for (auto& th : threads)
+        th.join();
+    sw.lab();
+
+    throughput_sample sample;
+    sample.num_threads = num_threads;
+    sample.num_ops = cfg.ops_per_thread * num_threads;
+    sample.num_failures = failures.load();
+    sample.elapsed_sec = sw.elapsed_sec();
+    return sample;
+}
+
+// Keeps a ring of `window` live allocations of log-uniform sizes and replaces the oldest one per operation.
+template <typename Buddy>
+throughput_sample run_pointer_ring(buddy_route_config const& cfg, Buddy& buddy) {
+    throughput_sample sample{};
+    sample.num_threads = 1;
+    std::minstd_rand rng{ 1 };
+    std::uniform_real_distribution<double> dist{ std::log2(static_cast<double>(cfg.min_request)),
+        std::log2(static_cast<double>(cfg.max_request)) };
+    std::vector<void*> ring(cfg.window, nullptr);
+    stop_watch sw;
+    for (uint64_t i = 0; i < cfg.num_ops; ++i) {
+        void*& slot = ring[i % cfg.window];
+        buddy.deallocate(slot);
+        slot = buddy.allocate(static_cast<uint64_t>(std::exp2(dist(rng))));
+        sample.num_failures += (slot == nullptr);
+    }
+    sw.lab();
+    for (void* p : ring)
+        buddy.deallocate(p);
+    sample.num_ops = cfg.num_ops;
+    sample.elapsed_sec = sw.elapsed_sec();
+    return sample;
+}
+
+uint64_t buddy_footprint(buddy_system const& buddy) {
+    return buddy.allocated_size();
+}
+
+uint64_t buddy_footprint(slab_buddy_system const& buddy) {
+    return buddy.buddy().allocated_size();
+}
+
+// run_pointer_ring over small requests; the footprint is taken before the ring is freed
+template <typename Buddy>
+buddy_slab_result run_small_ring(buddy_slab_config const& cfg, Buddy& buddy) {
+    buddy_slab_result result{};
+    result.throughput.num_threads = 1;
+    std::minstd_rand rng{ 1 };
+    std::uniform_real_distribution<double> dist{ std::log2(static_cast<double>(cfg.min_request)),
+        std::log2(static_cast<double>(cfg.max_request)) };
+    std::vector<void*> ring(cfg.window, nullptr);
+    std::vector<uint64_t> sizes(cfg.window, 0);
+    stop_watch sw;
+    for (uint64_t i = 0; i < cfg.num_ops; ++i) {
+        void*& slot = ring[i % cfg.window];
+        buddy.deallocate(slot);
+        sizes[i % cfg.window] = static_cast<uint64_t>(std::exp2(dist(rng)));
+        slot = buddy.allocate(sizes[i % cfg.window]);
+        result.throughput.num_failures += (slot == nullptr);
+    }
+    sw.lab();
+    for (unsigned i = 0; i < cfg.window; ++i)
+        result.requested += ring[i] != nullptr ? sizes[i] : 0;
+    result.footprint = buddy_footprint(buddy);
+    for (void* p : ring)
+        buddy.deallocate(p);
+    result.throughput.num_ops = cfg.num_ops;
+    result.throughput.elapsed_sec = sw.elapsed_sec();
+    return result;
+}
+
+} // namespace
+
+std::vector<throughput_sample> bench_locked_buddy_scaling(buddy_scaling_config const& cfg) {
+    std::vector<throughput_sample> samples;
+    auto buffer = make_aligned_raii_buffer<char>(cfg.region_size, DiskSectorSize);
+    if (buffer == nullptr)
+        return samples;
+    for (unsigned n = 1; n <= cfg.max_threads; n *= 2) {
+        std::mutex mtx;
+        buddy_system buddy{ memrgn_t{ buffer.get(), cfg.region_size }, cfg.align, cfg.min_cof };
+        samples.push_back(run_scaling_step(cfg, n,
+            [&](uint64_t size) {
+                std::lock_guard<std::mutex> guard{ mtx };
+                return buddy.allocate(size);
+            },
+            [&](void* p) {
+                if (p == nullptr)
+                    return;
+                std::lock_guard<std::mutex> guard{ mtx };
+                buddy.deallocate(p);
+            }));
+    }
+    return samples;
+}
+
+std::vector<throughput_sample> bench_concurrent_buddy_scaling(buddy_scaling_config const& cfg, unsigned const magazine_size) {
+    std::vector<throughput_sample> samples;
+    auto buffer = make_aligned_raii_buffer<char>(cfg.region_size, DiskSectorSize);
+    if (buffer == nullptr)
+        return samples;
+    for (unsigned n = 1; n <= cfg.max_threads; n *= 2) {
+        concurrent_buddy_system buddy{ memrgn_t{ buffer.get(), cfg.region_size }, cfg.align, cfg.min_cof, magazine_size };
+        samples.push_back(run_scaling_step(cfg, n,
+            [&](uint64_t size) { return buddy.allocate(size); },
+            [&](void* p) { buddy.deallocate(p); }));
+    }
+    return samples;
+}
+
+throughput_sample bench_buddy_route_discovery(buddy_route_config const& cfg) {
+    using namespace buddy_impl;
+    throughput_sample sample{};
+    sample.num_threads = 1;
+#if defined(ASH_ENV_UNIX)
+    // The block API never touches the region, so an address range is reserved without backing memory
+    void* base = mmap(nullptr, cfg.region_size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (base == MAP_FAILED)
+        return sample;
+    {
+        buddy_system buddy{ memrgn_t{ base, cfg.region_size }, cfg.align, cfg.min_cof };
+        std::minstd_rand rng{ 1 };
+        std::uniform_real_distribution<double> dist{ std::log2(static_cast<double>(cfg.min_request)),
+            std::log2(static_cast<double>(cfg.max_request)) };
+        std::vector<buddy_block*> ring(cfg.window, nullptr);
+        stop_watch sw;
+        for (uint64_t i = 0; i < cfg.num_ops; ++i) {
+            buddy_block*& slot = ring[i % cfg.window];
+            if (slot != nullptr)
+                buddy.deallocate_block(slot);
+            slot = buddy.allocate_block(static_cast<uint64_t>(std::exp2(dist(rng))));
+            sample.num_failures += (slot == nullptr);
+        }
+        sw.lab();
+        for (buddy_block* blk : ring) {
+            if (blk != nullptr)
+                buddy.deallocate_block(blk);
+        }
+        sample.num_ops = cfg.num_ops;
+        sample.elapsed_sec = sw.elapsed_sec();
+    }
+    munmap(base, cfg.region_size);
+#else
+    _ash_unused(cfg);
+#endif
+    return sample;
+}
+
+std::vector<throughput_sample> bench_buddy_metadata_layout(buddy_route_config const& cfg) {
+    std::vector<throughput_sample> samples;
+    auto buffer = make_aligned_raii_buffer<char>(cfg.region_size, DiskSectorSize);
+    if (buffer == nullptr)
+        return samples;
+    {
+        buddy_system buddy{ memrgn_t{ buffer.get(), cfg.region_size }, cfg.align, cfg.min_cof };
+        samples.push_back(run_pointer_ring(cfg, buddy));
+    }
+    {
+        compact_buddy_system buddy{ memrgn_t{ buffer.get(), cfg.region_size }, cfg.align, cfg.min_cof };
+        samples.push_back(run_pointer_ring(cfg, buddy));
+    }
+    return samples;
+}
+
+std::vector<buddy_slab_result> bench_buddy_slab(buddy_slab_config const& cfg) {
+    std::vector<buddy_slab_result> results;
+    auto buffer = make_aligned_raii_buffer<char>(cfg.region_size, DiskSectorSize);
+    if (buffer == nullptr)
+        return results;
+    {
+        buddy_system buddy{ memrgn_t{ buffer.get(), cfg.region_size }, cfg.align, cfg.min_cof };
+        results.push_back(run_small_ring(cfg, buddy));
+    }
+    {
+        slab_buddy_system buddy{ memrgn_t{ buffer.get(), cfg.region_size }, cfg.align, cfg.min_cof };
+        results.push_back(run_small_ring(cfg, buddy));
+    }
+    return results;
+}
+
+throughput_sample bench_buddy_batch(buddy_batch_config const& cfg, bool const batched) {
+    throughput_sample sample{};
+    sample.num_threads = 1;
+    auto buffer = make_aligned_raii_buffer<char>(cfg.region_size, DiskSectorSize);
+    if (buffer == nullptr)
+        return sample;
+    buddy_system buddy{ memrgn_t{ buffer.get(), cfg.region_size }, cfg.align, cfg.min_cof };
+    std::vector<void*> ptrs(cfg.batch, nullptr);
+    stop_watch sw;
+    for (unsigned r = 0; r < cfg.num_rounds; ++r) {
+        unsigned n = 0;
+        if (batched) {
+            n = buddy.allocate_batch(cfg.request, cfg.batch, ptrs.data());
+            buddy.deallocate_batch(ptrs.data(), n);
+        }
+        else {
+            for (; n < cfg.batch; ++n) {
+                ptrs[n] = buddy.allocate(cfg.request);
+                if (ptrs[n] == nullptr)
+                    break;
+            }
+            for (unsigned i = 0; i < n; ++i)
+                buddy.deallocate(ptrs[i]);
+        }
+        sample.num_ops += n;
+        sample.num_failures += cfg.batch - n;
+    }
+    sw.lab();
+    sample.elapsed_sec = sw.elapsed_sec();
+    return sample;
+}
+
+throughput_sample bench_buddy_churn(buddy_churn_config const& cfg, buddy_impl::lazy_coalescing_config const* lazy) {
+    throughput_sample sample{};
+    sample.num_threads = 1;
+    auto buffer = make_aligned_raii_buffer<char>(cfg.region_size, DiskSectorSize);
+    if (buffer == nullptr)
+        return sample;
+    buddy_system buddy{ memrgn_t{ buffer.get(), cfg.region_size }, cfg.align, cfg.min_cof };
+    if (lazy != nullptr)
+        buddy.enable_lazy_coalescing(*lazy);
+    std::minstd_rand rng{ 1 };
+    std::uniform_int_distribution<unsigned> percent{ 0, 99 };
+    std::uniform_int_distribution<uint64_t> other{ cfg.hot_request, cfg.max_request };
+    std::uniform_int_distribution<unsigned> victim{ 0, cfg.window - 1 };
+    std::vector<void*> live(cfg.window, nullptr);
+    stop_watch sw;
+    for (uint64_t i = 0; i < cfg.num_ops; ++i) {
+        void*& slot = live[victim(rng)];
+        buddy.deallocate(slot);
+        slot = buddy.allocate(percent(rng) < cfg.hot_percent ? cfg.hot_request : other(rng));
+        sample.num_failures += (slot == nullptr);
+    }
+    sw.lab();
+    for (void* p : live)
+        buddy.deallocate(p);
+    sample.num_ops = cfg.num_ops;
+    sample.elapsed_sec = sw.elapsed_sec();
+    return sample;
+}
+
+throughput_sample bench_buddy_remote_free(buddy_remote_free_config const& cfg, bool const remote) {
+    throughput_sample sample{};
+    sample.num_threads = cfg.num_workers + 1;
+    auto buffer = make_aligned_raii_buffer<char>(cfg.region_size, DiskSectorSize);
+    if (buffer == nullptr || cfg.num_workers == 0)
+        return sample;
+    std::mutex mtx;
+    buddy_system buddy{ memrgn_t{ buffer.get(), cfg.region_size }, cfg.align, cfg.min_cof };
+    // A single-producer single-consumer ring per worker; nullptr marks an empty slot
+    std::vector<std::atomic<void*>> rings(static_cast<size_t>(cfg.num_workers) * cfg.ring);
+    for (auto& slot : rings)
+        slot.store(nullptr, std::memory_order_relaxed);
+    std::atomic<bool> done{ false };
+    std::vector<std::thread> workers;
+    workers.reserve(cfg.num_workers);
+
+    stop_watch sw;
+    for (unsigned w = 0; w < cfg.num_workers; ++w) {
+        workers.emplace_back([&, w]() {
+            std::atomic<void*>* const ring = rings.data() + static_cast<size_t>(w) * cfg.ring;
+            for (uint64_t i = 0;; i = (i + 1) % cfg.ring) {
+                void* p;
+                while ((p = ring[i].load(std::memory_order_acquire)) == nullptr) {
+                    if (done.load(std::memory_order_acquire) && ring[i].load(std::memory_order_acquire) == nullptr)
+                        return;
+                    std::this_thread::yield();
+                }
+                ring[i].store(nullptr, std::memory_order_release);
+                if (remote) {
+                    buddy.deallocate_remote(p);
+                }
+                else {
+                    std::lock_guard<std::mutex> guard{ mtx };
+                    buddy.deallocate(p);
+                }
+            }
+        });
+    }
+
+    std::minstd_rand rng{ 1 };
+    std::uniform_int_distribution<uint64_t> dist{ cfg.min_request, cfg.max_request };
+    std::vector<uint64_t> cursor(cfg.num_workers, 0);
+    for (uint64_t i = 0; i < cfg.num_ops; ++i) {
+        void* p;
+        if (remote) {
+            p = buddy.allocate(dist(rng));
+        }
+        else {
+            std::lock_guard<std::mutex> guard{ mtx };
+            p = buddy.allocate(dist(rng));
+        }
+        if (p == nullptr) {
+            sample.num_failures += 1;
+            continue;
+        }
+        unsigned const w = static_cast<unsigned>(i % cfg.num_workers);
+        std::atomic<void*>& slot = rings[static_cast<size_t>(w) * cfg.ring + cursor[w]];
+        while (slot.load(std::memory_order_acquire) != nullptr)
+            std::this_thread::yield();
+        slot.store(p, std::memory_order_release);
+        cursor[w] = (cursor[w] + 1) % cfg.ring;
+    }
+    done.store(true, std::memory_order_release);
+    for (auto& th : workers)
+        th.join();
+    sw.lab();
+    buddy.drain_remote_frees();
+    sample.num_ops = cfg.num_ops;
+    sample.elapsed_sec = sw.elapsed_sec();
+    return sample;
+}
+
+buddy_placement_result bench_buddy_placement(buddy_churn_config const& cfg, buddy_impl::placement_policy const policy) {
+    buddy_placement_result result{};
+    result.throughput.num_threads = 1;
+    auto buffer = make_aligned_raii_buffer<char>(cfg.region_size, DiskSectorSize);
+    if (buffer == nullptr)
+        return result;
+    char const* const base = buffer.get();
+
+    for (bool const sampled : { false, true }) {
+        buddy_system buddy{ memrgn_t{ buffer.get(), cfg.region_size }, cfg.align, cfg.min_cof };
+        buddy.set_placement_policy(policy);
+        std::minstd_rand rng{ 1 };
+        std::uniform_int_distribution<unsigned> percent{ 0, 99 };
+        std::uniform_int_distribution<uint64_t> other{ cfg.hot_request, cfg.max_request };
+        std::uniform_int_distribution<unsigned> victim{ 0, cfg.window - 1 };
+        std::vector<void*> live(cfg.window, nullptr);
+        double frag_sum = 0.0, span_sum = 0.0;
+        uint64_t num_samples = 0;
+        stop_watch sw;
+        for (uint64_t i = 0; i < cfg.num_ops; ++i) {
+            void*& slot = live[victim(rng)];
+            buddy.deallocate(slot);
+            uint64_t const size = percent(rng) < cfg.hot_percent ? cfg.hot_request : other(rng);
+            slot = buddy.allocate(size);
+            if (!sampled) {
+                result.throughput.num_failures += (slot == nullptr);
+                continue;
+            }
+            if (slot != nullptr)
+                result.high_water = std::max<uint64_t>(result.high_water, static_cast<char const*>(slot) + size - base);
+            if ((i + 1) % cfg.window != 0)
+                continue;
+            uint64_t const free_size = buddy.max_alloc() - buddy.allocated_size();
+            frag_sum += free_size > 0 ? 1.0 - static_cast<double>(buddy.largest_free_block()) / static_cast<double>(free_size) : 0.0;
+            char const* lo = nullptr;
+            char const* hi = nullptr;
+            for (void* p : live) {
+                if (p == nullptr)
+                    continue;
+                char const* const c = static_cast<char const*>(p);
+                lo = lo == nullptr || c < lo ? c : lo;
+                hi = hi == nullptr || c + buddy.usable_size(p) > hi ? c + buddy.usable_size(p) : hi;
+            }
+            span_sum += lo != nullptr ? static_cast<double>(hi - lo) : 0.0;
+            num_samples += 1;
+        }
+        sw.lab();
+        for (void* p : live)
+            buddy.deallocate(p);
+        if (!sampled) {
+            result.throughput.num_ops = cfg.num_ops;
+            result.throughput.elapsed_sec = sw.elapsed_sec();
+        }
+        else if (num_samples > 0) {
+            result.external_fragmentation = frag_sum / static_cast<double>(num_samples);
+            result.live_span = span_sum / static_cast<double>(num_samples);
+        }
+    }
+    return result;
+}
+
+std::vector<throughput_sample> bench_buddy_table_lookup(buddy_table_lookup_config const& cfg) {
+    using namespace buddy_impl;
+    constexpr unsigned Align = 256;
+    constexpr cof_type RootCof = static_cast<cof_type>(GiB(64) / Align);
+    using fixed_table = static_buddy_table<RootCof, Align, 1>;
+    buddy_table const runtime{ RootCof, Align, 1 };
+
+    std::minstd_rand rng{ 1 };
+    std::uniform_real_distribution<double> dist{ std::log2(static_cast<double>(cfg.min_request)),
+        std::log2(static_cast<double>(cfg.max_request)) };
+    std::vector<uint64_t> sizes(4096);
+    for (uint64_t& size : sizes)
+        size = static_cast<uint64_t>(std::exp2(dist(rng)));
+
+    auto const measure = [&](auto&& best_fit) {
+        throughput_sample sample{};
+        sample.num_threads = 1;
+        uint64_t checksum = 0;
+        stop_watch sw;
+        for (uint64_t i = 0; i < cfg.num_lookups; ++i)
+            checksum += best_fit(sizes[i & (sizes.size() - 1)]);
+        sw.lab();
+        sample.num_ops = cfg.num_lookups;
+        sample.num_failures = (checksum == 0); // keeps the lookups alive
+        sample.elapsed_sec = sw.elapsed_sec();
+        return sample;
+    };
+    return {
+        measure([&](uint64_t size) { return runtime.best_fit(size); }),
+        measure([](uint64_t size) { return fixed_table::best_fit(size); })
+    };
+}
+
+void print_throughput_samples(std::ostream& os, char const* title, std::vector<throughput_sample> const& samples) {
+    os << title << '\n';
+    os << std::setw(8) << "threads" << std::setw(14) << "ops" << std::setw(10) << "fails"
+       << std::setw(12) << "sec" << std::setw(12) << "Mops/s" << '\n';
+    for (auto const& s : samples) {
+        os << std::setw(8) << s.num_threads << std::setw(14) << s.num_ops << std::setw(10) << s.num_failures
+           << std::setw(12) << std::fixed << std::setprecision(4) << s.elapsed_sec
+           << std::setw(12) << std::setprecision(2) << s.mops() << '\n';
+    }
+}
+
+} // !namespace ash
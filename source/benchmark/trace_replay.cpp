@@ -0,0 +1,385 @@
+#include <ash/benchmark/trace_replay.h>
+#include <ash/memory/buddy_system.h>
+#include <ash/memory/portable_buddy_system.h>
+#include <ash/memory/unordered_object_pool.h>
+#include <ash/stop_watch.h>
+#include <algorithm>
+#include <iomanip>
+#include <stdlib.h>
+
+#if defined(ASH_ENV_LINUX)
+#include <malloc.h>
+#endif
+
+namespace ash {
+
+constexpr double trace_replay_result::Percentiles[];
+
+namespace {
+
+class malloc_target final : public trace_replay_target {
+public:
+    char const* name() const override {
+        return "malloc";
+    }
+
+    void* allocate(uint64_t const size) override {
+        void* p = malloc(size);
+        if (p != nullptr)
+            _footprint += _usable_size(p, size);
+        return p;
+    }
+
+    void deallocate(void* p, uint64_t const size) override {
+        _footprint -= _usable_size(p, size);
+        free(p);
+    }
+
+    uint64_t footprint() const override {
+        return _footprint;
+    }
+
+private:
+    static uint64_t _usable_size(void* p, uint64_t const size) {
+#if defined(ASH_ENV_LINUX)
+        _ash_unused(size);
+        return malloc_usable_size(p);
+#else
+        _ash_unused(p);
+        return size;
+#endif
+    }
+
+    uint64_t _footprint = 0;
+};
+
+class buddy_system_target final : public trace_replay_target {
+public:
+    buddy_system_target(memrgn_t const& rgn, unsigned const align, unsigned const min_cof) :
+        _buddy(rgn, align, min_cof) {
+    }
+
+    char const* name() const override {
+        return "buddy_system";
+    }
+
+    void* allocate(uint64_t const size) override {
+        void* p = _buddy.allocate(size);
+        if (p != nullptr)
+            _footprint += _buddy.usable_size(p) + sizeof(void*);
+        return p;
+    }
+
+    void deallocate(void* p, uint64_t) override {
+        _footprint -= _buddy.usable_size(p) + sizeof(void*);
+        _buddy.deallocate(p);
+    }
+
+    uint64_t footprint() const override {
+        return _footprint;
+    }
+
+    double external_fragmentation() const override {
+        return _buddy.snapshot().external_fragmentation();
+    }
+
+private:
+    buddy_system _buddy;
+    uint64_t _footprint = 0;
+};
+
+class buddy_system_exact_target final : public trace_replay_target {
+public:
+    buddy_system_exact_target(memrgn_t const& rgn, unsigned const align, unsigned const min_cof) :
+        _buddy(rgn, align, min_cof) {
+    }
+
+    char const* name() const override {
+        return "buddy_system (exact)";
+    }
+
+    void* allocate(uint64_t const size) override {
+        void* p = _buddy.allocate_exact(size);
+        if (p != nullptr)
+            _footprint += _buddy.usable_size_exact(p) + 2 * sizeof(void*);
+        return p;
+    }
+
+    void deallocate(void* p, uint64_t) override {
+        _footprint -= _buddy.usable_size_exact(p) + 2 * sizeof(void*);
+        _buddy.deallocate_exact(p);
+    }
+
+    uint64_t footprint() const override {
+        return _footprint;
+    }
+
+    double external_fragmentation() const override {
+        return _buddy.snapshot().external_fragmentation();
+    }
+
+private:
+    buddy_system _buddy;
+    uint64_t _footprint = 0;
+};
+
+class portable_buddy_system_target final : public trace_replay_target {
+public:
+    portable_buddy_system_target(memrgn_t const& rgn, unsigned const align, unsigned const min_cof) :
+        _buddy(rgn, align, min_cof) {
+    }
+
+    char const* name() const override {
+        return "portable_buddy_system";
+    }
+
+    void* allocate(uint64_t const size) override {
+        void* p = _buddy.allocate(size);
+        if (p != nullptr)
+            _footprint += _buddy.usable_size(p);
+        return p;
+    }
+
+    void deallocate(void* p, uint64_t) override {
+        _footprint -= _buddy.usable_size(p);
+        _buddy.deallocate(p);
+    }
+
+    uint64_t footprint() const override {
+        return _footprint;
+    }
+
+    double external_fragmentation() const override {
+        return _buddy.snapshot().external_fragmentation();
+    }
+
+private:
+    portable_buddy_system _buddy;
+    uint64_t _footprint = 0;
+};
+
+class object_pool_target final : public trace_replay_target {
+public:
+    constexpr static unsigned MinClassBits = 4;
+    constexpr static unsigned MaxClassBits = 12;
+
+    object_pool_target() {
+        _add_pools<MinClassBits>();
+    }
+
+    char const* name() const override {
+        return "unordered_object_pool";
+    }
+
+    void* allocate(uint64_t const size) override {
+        unsigned const c = _size_class(size);
+        if (c < _pools.size())
+            return _pools[c]->allocate();
+        void* p = malloc(size);
+        _large += p != nullptr ? size : 0;
+        return p;
+    }
+
+    void deallocate(void* p, uint64_t const size) override {
+        unsigned const c = _size_class(size);
+        if (c < _pools.size()) {
+            _pools[c]->deallocate(p);
+            return;
+        }
+        _large -= size;
+        free(p);
+    }
+
+    uint64_t footprint() const override {
+        uint64_t bytes = _large;
+        for (auto const& pool : _pools)
+            bytes += pool->footprint();
+        return bytes;
+    }
+
+private:
+    struct pool_base {
+        virtual ~pool_base() = default;
+        virtual void* allocate() = 0;
+        virtual void deallocate(void* p) = 0;
+        virtual uint64_t footprint() const = 0;
+    };
+
+    template <size_t Size>
+    struct sized_pool final : pool_base {
+        struct slot {
+            char bytes[Size];
+        };
+
+        void* allocate() override {
+            return pool.allocate();
+        }
+
+        void deallocate(void* p) override {
+            pool.deallocate(static_cast<slot*>(p));
+        }
+
+        uint64_t footprint() const override {
+            return pool.capacity() * (sizeof(slot) + sizeof(void*));
+        }
+
+        unordered_object_pool<slot> pool;
+    };
+
+    template <unsigned Bits>
+    void _add_pools() {
+        _pools.emplace_back(new sized_pool<size_t{ 1 } << Bits>{});
+        if constexpr (Bits < MaxClassBits)
+            _add_pools<Bits + 1>();
+    }
+
+    static unsigned _size_class(uint64_t const size) {
+        if (size <= (uint64_t{ 1 } << MinClassBits))
+            return 0;
+        return 64 - count_leading_zeros(size - 1) - MinClassBits;
+    }
+
+    std::vector<std::unique_ptr<pool_base>> _pools;
+    uint64_t _large = 0;
+};
+
+void compute_percentiles(std::vector<uint32_t>& samples, uint64_t* out) {
+    for (unsigned i = 0; i < trace_replay_result::NumPercentiles; ++i) {
+        if (samples.empty()) {
+            out[i] = 0;
+            continue;
+        }
+        size_t const k = std::min(samples.size() - 1,
+            static_cast<size_t>(trace_replay_result::Percentiles[i] / 100.0 * static_cast<double>(samples.size())));
+        std::nth_element(samples.begin(), samples.begin() + k, samples.end());
+        out[i] = samples[k];
+    }
+}
+
+} // namespace
+
+std::unique_ptr<trace_replay_target> make_malloc_replay_target() {
+    return std::unique_ptr<trace_replay_target>{ new malloc_target{} };
+}
+
+std::unique_ptr<trace_replay_target> make_buddy_system_replay_target(memrgn_t const& rgn, unsigned const align, unsigned const min_cof) {
+    return std::unique_ptr<trace_replay_target>{ new buddy_system_target{ rgn, align, min_cof } };
+}
+
+std::unique_ptr<trace_replay_target> make_buddy_system_exact_replay_target(memrgn_t const& rgn, unsigned const align, unsigned const min_cof) {
+    return std::unique_ptr<trace_replay_target>{ new buddy_system_exact_target{ rgn, align, min_cof } };
+}
+
+std::unique_ptr<trace_replay_target> make_portable_buddy_system_replay_target(memrgn_t const& rgn, unsigned const align, unsigned const min_cof) {
+    return std::unique_ptr<trace_replay_target>{ new portable_buddy_system_target{ rgn, align, min_cof } };
+}
+
+std::unique_ptr<trace_replay_target> make_object_pool_replay_target() {
+    return std::unique_ptr<trace_replay_target>{ new object_pool_target{} };
+}
+
+trace_replay_result replay_alloc_trace(std::vector<alloc_trace_event> const& trace, trace_replay_target& target,
+    trace_replay_config const& cfg) {
+    using clock = std::chrono::steady_clock;
+    trace_replay_result result{};
+    result.target = target.name();
+
+    uint32_t max_id = 0;
+    for (alloc_trace_event const& e : trace)
+        max_id = std::max(max_id, e.id);
+    std::vector<void*> ptrs(max_id + 1u, nullptr);
+    std::vector<uint64_t> sizes(max_id + 1u, 0);
+    auto const release_all = [&]() {
+        for (uint32_t id = 0; id <= max_id; ++id) {
+            if (ptrs[id] != nullptr)
+                target.deallocate(ptrs[id], sizes[id]);
+            ptrs[id] = nullptr;
+        }
+    };
+
+    // Throughput
+    stop_watch sw;
+    for (alloc_trace_event const& e : trace) {
+        if (e.op == alloc_trace_op::Allocate) {
+            void* const p = target.allocate(e.size);
+            ptrs[e.id] = p;
+            sizes[e.id] = e.size;
+            result.num_allocs += 1;
+            result.num_failures += (p == nullptr);
+        }
+        else {
+            if (ptrs[e.id] != nullptr)
+                target.deallocate(ptrs[e.id], sizes[e.id]);
+            ptrs[e.id] = nullptr;
+            result.num_frees += 1;
+        }
+    }
+    sw.lab();
+    result.elapsed_sec = sw.elapsed_sec();
+    release_all();
+
+    // Latencies (including the clock overhead), footprint and the timeline
+    std::vector<uint32_t> alloc_lat, free_lat;
+    if (cfg.measure_latency) {
+        alloc_lat.reserve(result.num_allocs);
+        free_lat.reserve(result.num_frees);
+    }
+    uint64_t live = 0;
+    for (uint64_t i = 0; i < trace.size(); ++i) {
+        alloc_trace_event const& e = trace[i];
+        clock::time_point const t0 = cfg.measure_latency ? clock::now() : clock::time_point{};
+        if (e.op == alloc_trace_op::Allocate) {
+            void* const p = target.allocate(e.size);
+            if (cfg.measure_latency)
+                alloc_lat.push_back(static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - t0).count()));
+            ptrs[e.id] = p;
+            sizes[e.id] = e.size;
+            live += p != nullptr ? e.size : 0;
+        }
+        else if (ptrs[e.id] != nullptr) {
+            target.deallocate(ptrs[e.id], sizes[e.id]);
+            if (cfg.measure_latency)
+                free_lat.push_back(static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - t0).count()));
+            ptrs[e.id] = nullptr;
+            live -= sizes[e.id];
+        }
+        uint64_t const footprint = target.footprint();
+        result.peak_live_bytes = std::max(result.peak_live_bytes, live);
+        result.peak_footprint = std::max(result.peak_footprint, footprint);
+        if (cfg.timeline_interval > 0 && (i % cfg.timeline_interval == 0 || i + 1 == trace.size())) {
+            result.timeline.push_back(trace_replay_point{
+                i, e.timestamp_ns, live, footprint, target.external_fragmentation()
+            });
+        }
+    }
+    release_all();
+    compute_percentiles(alloc_lat, result.alloc_latency_ns);
+    compute_percentiles(free_lat, result.free_latency_ns);
+    return result;
+}
+
+void print_trace_replay_result(std::ostream& os, trace_replay_result const& result, bool const with_timeline) {
+    os << result.target << ": " << result.num_allocs << " allocs, " << result.num_frees << " frees, "
+       << result.num_failures << " failures, " << std::fixed << std::setprecision(2) << result.mops() << " Mops/s\n";
+    os << std::setw(14) << "latency (ns)";
+    for (char const* label : { "p50", "p90", "p99", "p99.9", "max" })
+        os << std::setw(10) << label;
+    os << '\n' << std::setw(14) << "allocate";
+    for (uint64_t const ns : result.alloc_latency_ns)
+        os << std::setw(10) << ns;
+    os << '\n' << std::setw(14) << "deallocate";
+    for (uint64_t const ns : result.free_latency_ns)
+        os << std::setw(10) << ns;
+    os << "\n  peak live bytes " << result.peak_live_bytes << ", peak footprint " << result.peak_footprint << '\n';
+    if (!with_timeline)
+        return;
+    os << std::setw(14) << "event" << std::setw(16) << "trace ms" << std::setw(16) << "live"
+       << std::setw(16) << "footprint" << std::setw(12) << "ext. frag" << '\n';
+    for (trace_replay_point const& pt : result.timeline) {
+        os << std::setw(14) << pt.event << std::setw(16) << std::setprecision(3) << static_cast<double>(pt.timestamp_ns) / 1e6
+           << std::setw(16) << pt.live_bytes << std::setw(16) << pt.footprint
+           << std::setw(12) << std::setprecision(4) << pt.external_fragmentation << '\n';
+    }
+}
+
+} // !namespace ash
@@ -0,0 +1,171 @@
+#include <ash/memory/alloc_trace.h>
+#include <string.h>
+
+namespace ash {
+
+namespace {
+
+constexpr char TraceMagic[8] = { 'A', 'S', 'H', 'T', 'R', 'A', 'C', 'E' };
+constexpr size_t TraceBufferSize = 64 * 1024;
+
+bool get_varint(uint8_t const*& it, uint8_t const* end, uint64_t& v) {
+    v = 0;
+    for (unsigned shift = 0; it != end && shift < 64; shift += 7) {
+        uint8_t const byte = *it++;
+        v |= static_cast<uint64_t>(byte & 0x7Fu) << shift;
+        if (!(byte & 0x80u))
+            return true;
+    }
+    return false;
+}
+
+} // namespace
+
+alloc_trace_recorder::alloc_trace_recorder() {
+    _fp = nullptr;
+    _next_id = 0;
+    _num_events = 0;
+}
+
+alloc_trace_recorder::~alloc_trace_recorder() noexcept {
+    close();
+}
+
+bool alloc_trace_recorder::open(char const* path) {
+    close();
+    std::lock_guard<std::mutex> guard{ _mtx };
+    _fp = fopen(path, "wb");
+    if (_fp == nullptr) {
+        perror(path);
+        return false;
+    }
+    uint32_t const header[2] = { Version, 0 };
+    fwrite(TraceMagic, sizeof TraceMagic, 1, _fp);
+    fwrite(header, sizeof header, 1, _fp);
+    _buf.reserve(TraceBufferSize + 32);
+    _ids.clear();
+    _free_ids.clear();
+    _next_id = 0;
+    _num_events = 0;
+    _last = clock::now();
+    return true;
+}
+
+void alloc_trace_recorder::close() noexcept {
+    std::lock_guard<std::mutex> guard{ _mtx };
+    if (_fp == nullptr)
+        return;
+    _flush();
+    fclose(_fp);
+    _fp = nullptr;
+}
+
+void alloc_trace_recorder::on_allocate(void const* p, uint64_t const size) {
+    if (p == nullptr)
+        return;
+    std::lock_guard<std::mutex> guard{ _mtx };
+    if (_fp == nullptr)
+        return;
+    uint32_t id;
+    if (!_free_ids.empty()) {
+        id = _free_ids.back();
+        _free_ids.pop_back();
+    }
+    else {
+        id = _next_id++;
+    }
+    _ids[p] = id;
+    _put_event(alloc_trace_op::Allocate, id, size);
+}
+
+void alloc_trace_recorder::on_deallocate(void const* p) {
+    if (p == nullptr)
+        return;
+    std::lock_guard<std::mutex> guard{ _mtx };
+    if (_fp == nullptr)
+        return;
+    auto const it = _ids.find(p);
+    if (it == _ids.end())
+        return; // allocated before the recorder was opened
+    uint32_t const id = it->second;
+    _ids.erase(it);
+    _free_ids.push_back(id);
+    _put_event(alloc_trace_op::Deallocate, id, 0);
+}
+
+void alloc_trace_recorder::_put_event(alloc_trace_op const op, uint32_t const id, uint64_t const size) {
+    clock::time_point const now = clock::now();
+    _buf.push_back(static_cast<uint8_t>(op));
+    _put_varint(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(now - _last).count()));
+    _put_varint(id);
+    if (op == alloc_trace_op::Allocate)
+        _put_varint(size);
+    _last = now;
+    _num_events += 1;
+    if (_buf.size() >= TraceBufferSize)
+        _flush();
+}
+
+void alloc_trace_recorder::_put_varint(uint64_t v) {
+    while (v >= 0x80u) {
+        _buf.push_back(static_cast<uint8_t>(v | 0x80u));
+        v >>= 7;
+    }
+    _buf.push_back(static_cast<uint8_t>(v));
+}
+
+void alloc_trace_recorder::_flush() {
+    if (!_buf.empty())
+        fwrite(_buf.data(), 1, _buf.size(), _fp);
+    _buf.clear();
+}
+
+bool load_alloc_trace(char const* path, std::vector<alloc_trace_event>& events) {
+    FILE* fp = fopen(path, "rb");
+    if (fp == nullptr) {
+        perror(path);
+        return false;
+    }
+    std::vector<uint8_t> bytes;
+    uint8_t chunk[TraceBufferSize];
+    size_t n;
+    while ((n = fread(chunk, 1, sizeof chunk, fp)) > 0)
+        bytes.insert(bytes.end(), chunk, chunk + n);
+    fclose(fp);
+
+    uint32_t header[2];
+    if (bytes.size() < sizeof TraceMagic + sizeof header || memcmp(bytes.data(), TraceMagic, sizeof TraceMagic) != 0) {
+        fprintf(stderr, "%s is not an allocation trace!\n", path);
+        return false;
+    }
+    memcpy(header, bytes.data() + sizeof TraceMagic, sizeof header);
+    if (header[0] != alloc_trace_recorder::Version) {
+        fprintf(stderr, "Unsupported version of an allocation trace: %u\n", header[0]);
+        return false;
+    }
+
+    events.clear();
+    uint8_t const* it = bytes.data() + sizeof TraceMagic + sizeof header;
+    uint8_t const* const end = bytes.data() + bytes.size();
+    uint64_t timestamp = 0;
+    while (it != end) {
+        alloc_trace_event e{};
+        uint64_t dt, id, size = 0;
+        e.op = static_cast<alloc_trace_op>(*it++);
+        bool ok = get_varint(it, end, dt) && get_varint(it, end, id);
+        if (ok && e.op == alloc_trace_op::Allocate)
+            ok = get_varint(it, end, size);
+        if (!ok || e.op > alloc_trace_op::Deallocate) {
+            fprintf(stderr, "A corrupted allocation trace: %s (event %zu)\n", path, events.size());
+            return false;
+        }
+        timestamp += dt;
+        e.id = static_cast<uint32_t>(id);
+        e.size = size;
+        e.timestamp_ns = timestamp;
+        events.push_back(e);
+    }
+    return true;
+}
+
+} // !namespace ash
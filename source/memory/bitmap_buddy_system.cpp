@@ -0,0 +1,226 @@
+#include <ash/memory/bitmap_buddy_system.h>
+#include <ash/pointer.h>
+#include <ash/utility/dbg_log.h>
+#include <assert.h>
+#include <string.h>
+#include <new>
+
+#ifndef __STDC_FORMAT_MACROS
+#define __STDC_FORMAT_MACROS
+#endif
+#include <inttypes.h>
+
+namespace ash {
+
+bitmap_buddy_system::bitmap_buddy_system() {
+    memset(&_rgn, 0, sizeof _rgn);
+    _align = 0;
+    _max_blk_size = 0;
+    _num_levels = 0;
+    _tree = nullptr;
+    _hint = nullptr;
+    _lv_min_cof = nullptr;
+    _total_allocated_size = 0;
+}
+
+bitmap_buddy_system::~bitmap_buddy_system() noexcept {
+    _cleanup();
+}
+
+bitmap_buddy_system::bitmap_buddy_system(memrgn_t const& rgn, unsigned const align, unsigned const min_cof) :
+    bitmap_buddy_system() {
+    init(rgn, align, min_cof);
+}
+
+void bitmap_buddy_system::init(memrgn_t const& rgn, unsigned const align, unsigned const min_cof) {
+    using namespace buddy_impl;
+    assert(ash::is_aligned_address(rgn.ptr, align));
+    _cleanup();
+    cof_type const root_cof = static_cast<cof_type>(rgn.size / align);
+    _tbl.init(root_cof, align, min_cof);
+    // The tree takes a byte per node, 2^levels bytes in all
+    if (_tbl.size() == 0 || _tbl.max_level() + 1 >= MaxLevels) {
+        fprintf(stderr, "Invalid geometry of a bitmap buddy system! (size: %" PRIu64 ", align: %u, min_cof: %u, levels: %u)\n",
+            rgn.size, align, min_cof, _tbl.size() == 0 ? 0u : static_cast<unsigned>(_tbl.max_level()) + 1);
+        _tbl.clear();
+        _num_levels = 0;
+        return; // not initialized; every allocation fails
+    }
+    _rgn = rgn;
+    _align = align;
+    _max_blk_size = root_cof * align;
+    _num_levels = _tbl.max_level() + 1;
+
+    // Node 0 is not used (heap order, root: 1)
+    uint64_t const num_nodes = uint64_t{ 1 } << _num_levels;
+    _tree = new (std::nothrow) std::atomic<uint8_t>[num_nodes];
+    _hint = new (std::nothrow) std::atomic<uint64_t>[_num_levels];
+    _lv_min_cof = new (std::nothrow) cof_type[_num_levels];
+    if (_tree == nullptr || _hint == nullptr || _lv_min_cof == nullptr) {
+        fprintf(stderr, "Bad alloc occured during initialize a bitmap tree of the buddy system!\n");
+        _cleanup();
+        return;
+    }
+    for (uint64_t i = 0; i < num_nodes; ++i)
+        _tree[i].store(0, std::memory_order_relaxed);
+    for (unsigned lv = 0; lv < _num_levels; ++lv)
+        _hint[lv].store(0, std::memory_order_relaxed);
+    for (blkidx_t i = 0; i < _tbl.size(); ++i)
+        _lv_min_cof[_tbl.level(i)] = _tbl.cof(i); // the smaller one comes last
+    _total_allocated_size = 0;
+    ASH_DMESG("Bitmap buddy system is online. [%p, %" PRIu64 "] (%" PRIu64 " nodes)", rgn.ptr, rgn.size, num_nodes - 1);
+}
+
+void* bitmap_buddy_system::allocate(uint64_t size) {
+    using namespace buddy_impl;
+    size += sizeof(node_t);
+    if (ASH_UNLIKELY(size > _max_blk_size || _tree == nullptr))
+        return nullptr;
+
+    blkidx_t const bidx = _tbl.best_fit(size);
+    level_t const lv = _tbl.level(bidx);
+    cof_type const need = _tbl.cof(bidx);
+    // At binary levels, only the larger blocks can serve a request of the larger coefficient
+    bool const check_cof = need > _lv_min_cof[lv];
+    uint64_t const count = uint64_t{ 1 } << lv;
+    uint64_t const start = _hint[lv].load(std::memory_order_relaxed);
+
+    node_t n = _scan_level(lv, start, count, need, check_cof);
+    if (n == 0)
+        n = _scan_level(lv, 0, start, need, check_cof);
+    if (n == 0)
+        return nullptr; // bad alloc
+    _hint[lv].store((n - count + 1) & (count - 1), std::memory_order_relaxed);
+
+    node_location const loc = locate_node(_tbl.cof(0), n);
+    assert(size <= static_cast<uint64_t>(loc.cof * _align));
+    _total_allocated_size.fetch_add(loc.cof * _align, std::memory_order_relaxed);
+    auto const p = static_cast<node_t*>(seek_pointer(_rgn.ptr, loc.offset * _align));
+    *p = n;
+    return p + 1;
+}
+
+void bitmap_buddy_system::deallocate(void* p) {
+    using namespace buddy_impl;
+    if (p == nullptr)
+        return;
+    node_t const n = *(static_cast<node_t*>(p) - 1);
+    assert(n > 0 && _depth(n) < _num_levels);
+    assert(_tree[n].load() & Occ);
+    node_location const loc = locate_node(_tbl.cof(0), n);
+    _total_allocated_size.fetch_sub(loc.cof * _align, std::memory_order_relaxed);
+    _free_node(n, 0);
+}
+
+// Returns an allocated node at the level, or zero if there is no node of a position [lo, hi) to be allocated.
+bitmap_buddy_system::node_t bitmap_buddy_system::_scan_level(
+    buddy_impl::level_t const lv, uint64_t const lo, uint64_t const hi,
+    buddy_impl::cof_type const need, bool const check_cof) {
+    using namespace buddy_impl;
+    node_t const first = uint64_t{ 1 } << lv;
+    uint64_t pos = lo;
+    while (pos < hi) {
+        node_t const n = first + pos;
+        if (_tree[n].load(std::memory_order_relaxed) != 0 ||
+            (check_cof && locate_node(_tbl.cof(0), n).cof < need)) {
+            pos += 1;
+            continue;
+        }
+        node_t const r = _try_alloc(n);
+        if (r == 0)
+            return n;
+        if (r == n) {
+            pos += 1;
+            continue;
+        }
+        // Skip the subtree of the allocated ancestor
+        pos = ((r + 1) << (lv - _depth(r))) - first;
+    }
+    return 0;
+}
+
+// Returns zero on success, the node itself if it is not free,
+// or an allocated ancestor that makes the node unavailable.
+bitmap_buddy_system::node_t bitmap_buddy_system::_try_alloc(node_t const n) {
+    uint8_t expected = 0;
+    if (!_tree[n].compare_exchange_strong(expected, Busy))
+        return n;
+
+    node_t current = n;
+    while (current > 1) {
+        node_t const child = current;
+        current >>= 1;
+        bool const is_left = (child & 0x1u) == 0;
+        uint8_t const occ = is_left ? OccLeft : OccRight;
+        uint8_t const coal = is_left ? CoalLeft : CoalRight;
+        uint8_t val = _tree[current].load();
+        uint8_t new_val;
+        do {
+            if (val & Occ) {
+                // Roll back marks of the nodes below the allocated ancestor
+                _free_node(n, _depth(child));
+                return current;
+            }
+            new_val = static_cast<uint8_t>((val & ~coal) | occ);
+        } while (!_tree[current].compare_exchange_weak(val, new_val));
+    }
+    return 0;
+}
+
+// Releases the node and propagates the release up to a level `upper_bound`.
+void bitmap_buddy_system::_free_node(node_t const n, unsigned const upper_bound) {
+    // Phase 1: announce the coalescing on the path
+    node_t runner = n;
+    node_t current = n >> 1;
+    while (_depth(runner) > upper_bound) {
+        bool const is_left = (runner & 0x1u) == 0;
+        uint8_t const old_val = _tree[current].fetch_or(is_left ? CoalLeft : CoalRight);
+        uint8_t const buddy_occ = is_left ? OccRight : OccLeft;
+        uint8_t const buddy_coal = is_left ? CoalRight : CoalLeft;
+        if ((old_val & buddy_occ) && !(old_val & buddy_coal))
+            break; // the buddy is in use, so the ancestors remain occupied
+        runner = current;
+        current >>= 1;
+    }
+
+    // Phase 2: release the node
+    _tree[n].store(0);
+
+    // Phase 3: clear the marks unless an allocation took over the path
+    if (_depth(n) != upper_bound)
+        _unmark(n, upper_bound);
+}
+
+void bitmap_buddy_system::_unmark(node_t const n, unsigned const upper_bound) {
+    node_t current = n;
+    uint8_t new_val;
+    uint8_t buddy_occ;
+    do {
+        node_t const child = current;
+        current >>= 1;
+        bool const is_left = (child & 0x1u) == 0;
+        uint8_t const occ = is_left ? OccLeft : OccRight;
+        uint8_t const coal = is_left ? CoalLeft : CoalRight;
+        buddy_occ = is_left ? OccRight : OccLeft;
+        uint8_t val = _tree[current].load();
+        do {
+            if (!(val & coal))
+                return;
+            new_val = static_cast<uint8_t>(val & ~(occ | coal));
+        } while (!_tree[current].compare_exchange_weak(val, new_val));
+    } while (_depth(current) > upper_bound && !(new_val & buddy_occ));
+}
+
+void bitmap_buddy_system::_cleanup() {
+    if (_tree != nullptr && _total_allocated_size.load() != 0)
+        fprintf(stderr, "Bitmap buddy system detects memory leak!\n");
+    delete[] _tree;
+    delete[] _hint;
+    delete[] _lv_min_cof;
+    _tree = nullptr;
+    _hint = nullptr;
+    _lv_min_cof = nullptr;
+    _tbl.clear();
+}
+
+} // !namespace ash
@@ -0,0 +1,69 @@
+#include <ash/memory/buddy_block_index.h>
+#include <ash/numeric.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+namespace ash {
+namespace buddy_impl {
+
+block_index::block_index() {
+    _base = nullptr;
+    _size = 0;
+    _align = 0;
+    _shift = -1;
+    _dir = nullptr;
+    _dir_size = 0;
+    _num_leaves = 0;
+}
+
+block_index::~block_index() noexcept {
+    clear();
+}
+
+bool block_index::init(memrgn_t const& rgn, unsigned const align) {
+    clear();
+    assert(align > 0);
+    uint64_t const num_keys = rgn.size / align + 1;
+    _dir_size = (num_keys + LeafSize - 1) >> LeafBits;
+    _dir = static_cast<buddy_block***>(calloc(_dir_size, sizeof(buddy_block**)));
+    if (_dir == nullptr) {
+        fprintf(stderr, "Bad alloc occured during initialize a block index of the buddy system!\n");
+        _dir_size = 0;
+        return false;
+    }
+    _base = static_cast<char const*>(rgn.ptr);
+    _size = rgn.size;
+    _align = align;
+    _shift = is_power_of_two(align) ? static_cast<int>(log2u_nz(align)) : -1;
+    return true;
+}
+
+void block_index::clear() noexcept {
+    for (uint64_t i = 0; i < _dir_size; ++i)
+        free(_dir[i]);
+    free(_dir);
+    _base = nullptr;
+    _size = 0;
+    _align = 0;
+    _shift = -1;
+    _dir = nullptr;
+    _dir_size = 0;
+    _num_leaves = 0;
+}
+
+bool block_index::insert(void const* p, buddy_block* blk) {
+    uint64_t const key = _key(p);
+    buddy_block**& leaf = _dir[key >> LeafBits];
+    if (ASH_UNLIKELY(leaf == nullptr)) {
+        leaf = static_cast<buddy_block**>(calloc(LeafSize, sizeof(buddy_block*)));
+        if (leaf == nullptr)
+            return false; // bad alloc
+        _num_leaves += 1;
+    }
+    assert(leaf[key & (LeafSize - 1)] == nullptr);
+    leaf[key & (LeafSize - 1)] = blk;
+    return true;
+}
+
+} // !namespace buddy_impl
+} // !namespace ash
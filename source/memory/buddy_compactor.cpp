@@ -0,0 +1,153 @@
+#include <ash/memory/buddy_compactor.h>
+#include <assert.h>
+
+namespace ash {
+
+buddy_compactor::buddy_compactor(buddy_system& buddy, relocate_callback_t callback, bool const block_headers) :
+    _buddy(buddy), _callback(std::move(callback)), _block_headers(block_headers) {
+    _status = compaction_status::Idle;
+    memset(&_target, 0, sizeof _target);
+    _planned_bytes = 0;
+    _moved_bytes = 0;
+    _num_moves = 0;
+}
+
+buddy_compactor::~buddy_compactor() noexcept {
+    abort();
+}
+
+// Returns false if the buddy system has no subtree of the size.
+bool buddy_compactor::plan(uint64_t size) {
+    abort();
+    _planned_bytes = 0;
+    _moved_bytes = 0;
+    _num_moves = 0;
+    if (_block_headers)
+        size += sizeof(buddy_block**);
+    if (_buddy._root == nullptr || size > _buddy.max_alloc())
+        return false;
+
+    candidate best{ nullptr, 0 };
+    _survey(_buddy._root, size, best);
+    if (best.node == nullptr)
+        return false;
+    _target = best.node->rgn;
+    _planned_bytes = best.cost;
+    if (!best.node->in_use) {
+        _status = compaction_status::Done; // already free
+        return true;
+    }
+    _buddy._set_fence(_target);
+    _fence_subtree(best.node);
+    _status = compaction_status::InProgress;
+    return true;
+}
+
+// Moves live blocks of the target until `budget` bytes are moved (at least one block per call).
+compaction_status buddy_compactor::step(uint64_t const budget) {
+    if (_status != compaction_status::InProgress && _status != compaction_status::OutOfMemory)
+        return _status;
+
+    uint64_t moved = 0;
+    while (!_pending.empty() && (moved == 0 || moved < budget)) {
+        buddy_block* block = _pending.back();
+        if (block->pinned) {
+            _pending.pop_back(); // freed by the user after the plan
+            continue;
+        }
+        // A block at least as large (the larger neighbour of an R-A3B1 block may serve it), so every
+        // usable byte of the source (not only the requested ones) is kept
+        buddy_block* dst = _buddy.try_allocate_block(block->rgn.size);
+        if (dst == nullptr) {
+            _status = compaction_status::OutOfMemory;
+            return _status;
+        }
+        assert(dst->rgn.size >= block->rgn.size);
+        buddy_system::_sub_counter(_buddy._requested_size, dst->requested - block->requested);
+        dst->requested = block->requested;
+        void* from = block->rgn.ptr;
+        void* to = dst->rgn.ptr;
+        uint64_t bytes = block->rgn.size;
+        if (_block_headers) {
+            *static_cast<buddy_block**>(to) = dst;
+            from = static_cast<buddy_block**>(from) + 1;
+            to = static_cast<buddy_block**>(to) + 1;
+            bytes -= sizeof(buddy_block**);
+        }
+        _callback(from, to, bytes);
+        _pending.pop_back();
+        moved += block->rgn.size;
+        _buddy.deallocate_block(block); // pinned by the fence
+        _num_moves += 1;
+    }
+    _moved_bytes += moved;
+
+    if (_pending.empty()) {
+        _buddy._lift_fence();
+        _status = compaction_status::Done;
+    }
+    else {
+        _status = compaction_status::InProgress;
+    }
+    return _status;
+}
+
+// Cancels the plan; blocks moved so far stay at their new places.
+void buddy_compactor::abort() {
+    if (_status == compaction_status::InProgress || _status == compaction_status::OutOfMemory)
+        _buddy._lift_fence();
+    _pending.clear();
+    _status = compaction_status::Idle;
+}
+
+uint64_t buddy_compactor::_live_bytes(buddy_block const* node) {
+    if (_is_split(node))
+        return _live_bytes(node->left) + _live_bytes(node->left->pair);
+    return node->in_use ? node->rgn.size : 0;
+}
+
+// False if the subtree holds a block which must not be moved
+bool buddy_compactor::_is_movable(buddy_block const* node) {
+    if (_is_split(node))
+        return _is_movable(node->left) && _is_movable(node->left->pair);
+    return !(node->in_use && node->fixed);
+}
+
+// Finds the smallest subtrees which can hold the size, and keeps the one with the fewest live bytes.
+void buddy_compactor::_survey(buddy_block* node, uint64_t const size, candidate& best) const {
+    if (node->rgn.size < size)
+        return;
+    if (!_is_split(node) || node->left->rgn.size < size) {
+        if (!_is_movable(node))
+            return;
+        uint64_t const cost = _live_bytes(node);
+        if (best.node == nullptr || cost < best.cost ||
+            (cost == best.cost && node->rgn.size < best.node->rgn.size)) {
+            best.node = node;
+            best.cost = cost;
+        }
+        return;
+    }
+    _survey(node->left, size, best);
+    _survey(node->left->pair, size, best);
+}
+
+// Pins free blocks of the subtree and queues its live blocks.
+void buddy_compactor::_fence_subtree(buddy_block* node) {
+    if (_is_split(node)) {
+        _fence_subtree(node->left);
+        _fence_subtree(node->left->pair);
+        return;
+    }
+    if (node->in_use) {
+        _pending.push_back(node);
+        return;
+    }
+    _buddy._flist_v[node->blkidx].remove_node(node->inv);
+    _buddy._on_free_list_remove(node);
+    node->in_use = true;
+    node->inv = nullptr;
+    _buddy._pin_block(node);
+}
+
+} // !namespace ash
@@ -0,0 +1,133 @@
+#include <ash/memory/buddy_route_table.h>
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+namespace ash {
+namespace buddy_impl {
+
+namespace {
+
+// Replays the route discovery of buddy_system::_create_route over empty free lists
+class route_recorder {
+public:
+    route_recorder(buddy_table const& tbl, uint64_t* cand, uint8_t* order, uint8_t* prefix, route_entry* route) :
+        _tbl(tbl), _cand(cand), _order(order), _prefix(prefix), _route(route), _num_probes(0), _num_entries(0) {
+    }
+
+    void record(blkidx_t bidx) {
+        _probe(bidx);
+
+        auto prop = _tbl.property(bidx);
+        if (prop.check(RareBuddyBlock | A3B1Pattern))
+            return record(bidx - 1);
+
+        _append(bidx, prop.offset);
+
+        if (prop.check(RareBuddyBlock | A1B3Pattern))
+            return record(bidx - prop.dist);
+
+        do {
+            bidx -= prop.dist;
+            prop = _tbl.property(bidx);
+            if (prop.check(UniqueBuddyBlock)) {
+                _probe(bidx);
+                _append(bidx, false);
+            }
+            else if (prop.check(A1B3Pattern)) {
+                _probe(bidx);
+                _probe(bidx + 1);
+                _append(bidx + 1, true);
+            }
+            else if (prop.check(A3B1Pattern)) {
+                _probe(bidx + 1);
+                _probe(bidx);
+                _append(bidx, false);
+            }
+        } while (bidx > 0);
+
+        _probe(0);
+    }
+
+private:
+    void _probe(blkidx_t const idx) {
+        uint64_t const bit = uint64_t{ 1 } << (idx % 64);
+        if (_cand[idx / 64] & bit)
+            return; // keep the first probe
+        _cand[idx / 64] |= bit;
+        _order[idx] = static_cast<uint8_t>(_num_probes++);
+        _prefix[idx] = static_cast<uint8_t>(_num_entries);
+    }
+
+    void _append(blkidx_t const idx, bool const offset) {
+        _route[_num_entries].idx = idx;
+        _route[_num_entries].offset = offset;
+        _num_entries += 1;
+    }
+
+    buddy_table const& _tbl;
+    uint64_t* _cand;
+    uint8_t* _order;
+    uint8_t* _prefix;
+    route_entry* _route;
+    unsigned _num_probes;
+    unsigned _num_entries;
+};
+
+} // namespace
+
+buddy_route_table::buddy_route_table() {
+    _tbl_size = 0;
+    _route_size = 0;
+    _cand_v = nullptr;
+    _order_v = nullptr;
+    _prefix_v = nullptr;
+    _route_v = nullptr;
+}
+
+buddy_route_table::~buddy_route_table() noexcept {
+    clear();
+}
+
+bool buddy_route_table::init(buddy_table const& tbl) {
+    clear();
+    unsigned const n = tbl.size();
+    if (n == 0 || n > MaxTableSize) {
+        fprintf(stderr, "A buddy table of %u block indices is not supported by the route table!\n", n);
+        return false;
+    }
+    _tbl_size = n;
+    _route_size = n + 1;
+    _cand_v = static_cast<uint64_t*>(calloc(static_cast<size_t>(n) * MaskWords, sizeof(uint64_t)));
+    _order_v = static_cast<uint8_t*>(calloc(static_cast<size_t>(n) * n, sizeof(uint8_t)));
+    _prefix_v = static_cast<uint8_t*>(calloc(static_cast<size_t>(n) * n, sizeof(uint8_t)));
+    _route_v = static_cast<route_entry*>(calloc(static_cast<size_t>(n) * _route_size, sizeof(route_entry)));
+    if (_cand_v == nullptr || _order_v == nullptr || _prefix_v == nullptr || _route_v == nullptr) {
+        fprintf(stderr, "Bad alloc occured during initialize a route table of the buddy system!\n");
+        clear();
+        return false;
+    }
+    for (blkidx_t t = 0; t < n; ++t) {
+        route_recorder recorder{ tbl,
+            &_cand_v[t * MaskWords], &_order_v[t * n], &_prefix_v[t * n], &_route_v[t * _route_size] };
+        recorder.record(t);
+    }
+    return true;
+}
+
+void buddy_route_table::clear() noexcept {
+    free(_cand_v);
+    free(_order_v);
+    free(_prefix_v);
+    free(_route_v);
+    _tbl_size = 0;
+    _route_size = 0;
+    _cand_v = nullptr;
+    _order_v = nullptr;
+    _prefix_v = nullptr;
+    _route_v = nullptr;
+}
+
+} // !namespace buddy_impl
+} // !namespace ash
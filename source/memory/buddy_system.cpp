@@ -1,22 +1,69 @@
 #include <ash/memory/buddy_system.h>
+#include <ash/numeric.h>
 #include <ash/pointer.h>
 #include <ash/utility/dbg_log.h>
+#include <algorithm>
+#include <limits>
+#include <new>
 
 #ifndef __STDC_FORMAT_MACROS
 #define __STDC_FORMAT_MACROS
 #endif
 #include <inttypes.h>
 
+#ifdef ASH_BUDDY_SYSTEM_ALLOCATION_TRACE
+#define ASH_BUDDY_TRACE(call) do { if (_trace != nullptr) _trace->call; } while (false)
+#else
+#define ASH_BUDDY_TRACE(call) ((void)0)
+#endif // !ASH_BUDDY_SYSTEM_ALLOCATION_TRACE
 
 namespace ash {
 
+namespace {
+
+// Orders the address heaps of address-ordered placement as min-heaps
+struct address_greater {
+    template <typename Entry>
+    bool operator()(Entry const& a, Entry const& b) const {
+        return a.ptr > b.ptr;
+    }
+};
+
+} // namespace
+
 buddy_system::buddy_system() {
     memset(&_rgn, 0, sizeof _rgn);
     _align = 0;
     _max_blk_size = 0;
     _flist_v = nullptr;
+    _root = nullptr;
+    memset(&_fence, 0, sizeof _fence);
+    _lazy_size = 0;
+    _lazy_watermark = 0;
+    _coalescing = false;
+    _placement = buddy_impl::placement_policy::Mixed;
+    memset(_nonempty_mask, 0, sizeof _nonempty_mask);
     _total_allocated_size = 0;
     memset(&_status, 0, sizeof(buddy_impl::buddy_system_status));
+    _level_counter_v = nullptr;
+    for (int64_t& wm : _pressure_wm)
+        wm = std::numeric_limits<int64_t>::max();
+    _pressure_hysteresis = 0;
+    _pressure = buddy_impl::pressure_level::Normal;
+    _pressure_pending = false;
+    _in_pressure_dispatch = false;
+    _next_pressure_cb_id = 0;
+    _update_pressure_bounds();
+    _num_failures = 0;
+    memset(&_last_failure, 0, sizeof _last_failure);
+    _requested_size = 0;
+    for (std::atomic<uint64_t>& n : _request_hist)
+        n.store(0, std::memory_order_relaxed);
+    for (std::atomic<uint64_t>& n : _realloc_count)
+        n.store(0, std::memory_order_relaxed);
+#ifdef ASH_BUDDY_SYSTEM_ALLOCATION_TRACE
+    _trace = nullptr;
+#endif // !ASH_BUDDY_SYSTEM_ALLOCATION_TRACE
 }
 
 buddy_system::~buddy_system() {
@@ -33,20 +80,49 @@ void buddy_system::init(memrgn_t const& rgn, unsigned const align, unsigned cons
     using namespace buddy_impl;
     assert(ash::is_aligned_address(_rgn.ptr, align));
     cof_type const root_cof = static_cast<cof_type>(rgn.size / align);
+    _tbl.init(root_cof, align, min_cof);
+    // The route table and the bitmask of non-empty free lists hold at most MaxTableSize block indices
+    if (!_routes.init(_tbl)) {
+        fprintf(stderr, "Invalid geometry of a buddy system! (size: %" PRIu64 ", align: %u, min_cof: %u, block indices: %u)\n",
+            rgn.size, align, min_cof, _tbl.size());
+        _tbl.clear();
+        return; // not initialized; every allocation fails
+    }
     _rgn = rgn;
     _align = align;
     _max_blk_size = root_cof * align;
-    _tbl.init(root_cof, align, min_cof);
     auto block = _block_pool.allocate();
     block->cof = root_cof;
     block->blkidx = 0;
     block->rgn = _rgn;
     block->pair = nullptr;
     block->parent = nullptr;
+    block->left = nullptr;
     block->in_use = false;
+    block->pinned = false;
+    block->fixed = false;
+    block->lazy = 0;
+    block->gen = 0;
+    _root = block;
     _flist_v = _init_free_list_vec(_tbl.size(), _node_pool);
-    _flist_v[0].emplace_front(block);
+    delete[] _level_counter_v;
+    _level_counter_v = new (std::nothrow) level_counter[_tbl.size()];
+    if (_level_counter_v == nullptr) {
+        fprintf(stderr, "Bad alloc occured during initialize counters of the buddy system!\n");
+        return;
+    }
+    for (blkidx_t i = 0; i < _tbl.size(); ++i) {
+        _level_counter_v[i].num_free = 0;
+        _level_counter_v[i].num_used = 0;
+    }
+    memset(_nonempty_mask, 0, sizeof _nonempty_mask);
+    _address_heap_v.clear();
+    if (_placement == placement_policy::AddressOrdered)
+        _address_heap_v.resize(_tbl.size());
+    _push_free(block, true);
     _route.reserve(_tbl.max_level());
+    _merge_v.assign(_tbl.max_level() + 1, std::vector<buddy_block*>{});
+    _exact_v.reserve(_tbl.max_level() + 1); // an exact allocation holds a block per level at most
     _total_allocated_size = 0;
     ASH_DMESG("Buddy system is online. [%p, %" PRIu64 "]", rgn.ptr, rgn.size);
 }
@@ -60,16 +136,195 @@ void* buddy_system::allocate(uint64_t size) {
 
     auto const p = static_cast<buddy_block**>(block->rgn.ptr);
     *p = block;
+    ASH_BUDDY_TRACE(on_allocate(p + 1, size - sizeof(buddy_block**)));
+    return p + 1;
+}
+
+void* buddy_system::try_allocate(uint64_t size) {
+    size += sizeof(buddy_block**);
+    buddy_block* block = try_allocate_block(size);
+    if (block == nullptr)
+        return nullptr;
+
+    auto const p = static_cast<buddy_block**>(block->rgn.ptr);
+    *p = block;
+    ASH_BUDDY_TRACE(on_allocate(p + 1, size - sizeof(buddy_block**)));
     return p + 1;
 }
 
 void buddy_system::deallocate(void* p) {
     if (p == nullptr)
         return;
+    ASH_BUDDY_TRACE(on_deallocate(p));
     deallocate_block(*(static_cast<buddy_block**>(p) - 1));
 }
 
+uint64_t buddy_system::largest_free_block() const {
+    // Block indices grow as coefficients shrink, so the lowest non-empty index is the largest block
+    for (unsigned w = 0; w < buddy_impl::buddy_route_table::MaskWords; ++w) {
+        if (_nonempty_mask[w] != 0)
+            return static_cast<uint64_t>(_tbl.cof(w * 64 + count_trailing_zeros(_nonempty_mask[w]))) * _align;
+    }
+    return 0;
+}
+
+uint64_t buddy_system::usable_size(void const* p) const {
+    return (*(static_cast<buddy_block* const*>(p) - 1))->rgn.size - sizeof(buddy_block**);
+}
+
+// Every block begins at a multiple of the granule, so blocks are aligned if the alignment does
+// not exceed it. Otherwise, a block larger by the padding to the next aligned address is taken,
+// which is less than the alignment, and a single block is granted either way.
+void* buddy_system::allocate_aligned(uint64_t const size, uint64_t const alignment) {
+    using namespace buddy_impl;
+    assert(is_power_of_two(alignment));
+    if (ASH_UNLIKELY(!_aligned_index.initialized()) && !_aligned_index.init(_rgn, _align))
+        return nullptr;
+    uint64_t const base = reinterpret_cast<uintptr_t>(_rgn.ptr);
+    uint64_t const granule = std::min(base & (~base + 1), static_cast<uint64_t>(_align & (~_align + 1)));
+    buddy_block* const block = allocate_block(alignment > granule ? size + alignment - granule : size);
+    if (block == nullptr)
+        return nullptr;
+    char* const p = reinterpret_cast<char*>(aligned_size(reinterpret_cast<uintptr_t>(block->rgn.ptr), alignment));
+    if (!_aligned_index.insert(p, block)) {
+        deallocate_block(block);
+        return nullptr; // bad alloc
+    }
+    block->fixed = true; // the index maps the pointer to this block
+    ASH_BUDDY_TRACE(on_allocate(p, size));
+    return p;
+}
+
+void buddy_system::deallocate_aligned(void* p) {
+    if (p == nullptr)
+        return;
+    ASH_BUDDY_TRACE(on_deallocate(p));
+    buddy_block* const block = _aligned_index.erase(p);
+    assert(block != nullptr);
+    deallocate_block(block);
+}
+
+void* buddy_system::allocate_exact(uint64_t const size) {
+    uint64_t const total = size + sizeof(exact_header);
+    _drain_remote_if_any();
+    buddy_block* top = _allocate_block(total);
+    if (ASH_UNLIKELY(top == nullptr) && _on_alloc_failure(total))
+        top = _allocate_block(total);
+    void* p = nullptr;
+    if (top != nullptr) {
+        auto const header = static_cast<exact_header*>(top->rgn.ptr);
+        header->last = _trim_block(top, total);
+        header->top = top;
+        p = header + 1;
+        ASH_BUDDY_TRACE(on_allocate(p, size));
+    }
+    // Pressure is dispatched once the tail is returned
+    _dispatch_pressure_if_pending();
+    return p;
+}
+
+// Blocks are freed from the deepest one, so every block merges with the tail freed before it
+void buddy_system::deallocate_exact(void* p) {
+    if (p == nullptr)
+        return;
+    ASH_BUDDY_TRACE(on_deallocate(p));
+    exact_header const header = *(static_cast<exact_header*>(p) - 1);
+    // Merges free the descriptors of the ancestors, so the blocks are collected first
+    _exact_v.push_back(header.last);
+    for (buddy_block* block = header.last; block != header.top; block = block->parent) {
+        if (block->parent->left != block)
+            _exact_v.push_back(block->parent->left);
+    }
+    for (buddy_block* block : _exact_v) {
+        _on_block_released(block);
+        _deallocate(block);
+    }
+    _exact_v.clear();
+    _dispatch_pressure_if_pending();
+}
+
+uint64_t buddy_system::usable_size_exact(void const* p) const {
+    exact_header const* const header = static_cast<exact_header const*>(p) - 1;
+    char const* const end = static_cast<char const*>(header->last->rgn.ptr) + header->last->rgn.size;
+    return static_cast<uint64_t>(end - static_cast<char const*>(p));
+}
+
+void* buddy_system::reallocate(void* p, uint64_t const size, buddy_impl::realloc_path* path) {
+    using namespace buddy_impl;
+    if (p == nullptr) {
+        void* q = allocate(size);
+        if (path != nullptr)
+            *path = q != nullptr ? realloc_path::Moved : realloc_path::Failed;
+        return q;
+    }
+
+    auto const header = static_cast<buddy_block**>(p) - 1;
+    buddy_block* block = resize_block(*header, size + sizeof(buddy_block**), path);
+    if (block != nullptr) {
+        *header = block; // a resized block begins at the same address
+        ASH_BUDDY_TRACE(on_deallocate(p));
+        ASH_BUDDY_TRACE(on_allocate(p, size));
+        return p;
+    }
+
+    // Fallback: move
+    buddy_block* const old_block = *header;
+    void* q = allocate(size);
+    realloc_path const taken = q != nullptr ? realloc_path::Moved : realloc_path::Failed;
+    _add_counter(_realloc_count[static_cast<unsigned>(taken)], 1);
+    if (path != nullptr)
+        *path = taken;
+    if (q == nullptr)
+        return nullptr; // bad alloc; the old block remains
+    uint64_t const old_size = old_block->rgn.size - sizeof(buddy_block**);
+    memcpy(q, p, old_size < size ? old_size : size);
+    ASH_BUDDY_TRACE(on_deallocate(p));
+    deallocate_block(old_block);
+    return q;
+}
+
+buddy_system::buddy_block* buddy_system::resize_block(buddy_block* blk, uint64_t const size, buddy_impl::realloc_path* path) {
+    using namespace buddy_impl;
+    assert(blk != nullptr && blk->in_use);
+    if (ASH_UNLIKELY(size > _max_blk_size || _is_fenced(blk)))
+        return nullptr; // fenced blocks are moved out of the fence
+    realloc_path taken;
+    buddy_block* block;
+    uint64_t const capacity = static_cast<uint64_t>(blk->cof) * _align;
+    if (size > capacity) {
+        block = _grow_block(blk, size);
+        taken = realloc_path::Grown;
+    }
+    else {
+        block = _shrink_block(blk, size);
+        taken = block != blk ? realloc_path::Shrunk : realloc_path::Unchanged;
+    }
+    if (block == nullptr)
+        return nullptr;
+    _add_counter(_realloc_count[static_cast<unsigned>(taken)], 1);
+    if (path != nullptr)
+        *path = taken;
+    _dispatch_pressure_if_pending();
+    return block;
+}
+
 buddy_system::buddy_block* buddy_system::allocate_block(uint64_t const size) {
+    _drain_remote_if_any();
+    buddy_block* block = _allocate_block(size);
+    if (ASH_UNLIKELY(block == nullptr) && _on_alloc_failure(size))
+        block = _allocate_block(size);
+    _dispatch_pressure_if_pending();
+    return block;
+}
+
+buddy_system::buddy_block* buddy_system::try_allocate_block(uint64_t const size) {
+    _drain_remote_if_any();
+    buddy_block* const block = _allocate_block(size);
+    _dispatch_pressure_if_pending();
+    return block;
+}
+
+buddy_system::buddy_block* buddy_system::_allocate_block(uint64_t const size) {
     using namespace buddy_impl;
     if (ASH_UNLIKELY(size > _max_blk_size))
         return nullptr;
@@ -79,13 +334,24 @@ buddy_system::buddy_block* buddy_system::allocate_block(uint64_t const size) {
     assert(_route_dbg.empty());
 #endif // !ASH_DEBUG_ENABLE_BUDDY_ROUTE_CORRECTNESS_CHECKING
     blkidx_t bf = _tbl.best_fit(size);
-    auto const result = _create_route(bf);
+    auto result = _create_route(bf);
     if (!result.success) {
         _route.clear();
 #ifdef ASH_DEBUG_ENABLE_BUDDY_ROUTE_CORRECTNESS_CHECKING
         _route_dbg.clear();
 #endif // !ASH_DEBUG_ENABLE_BUDDY_ROUTE_CORRECTNESS_CHECKING
-        return nullptr; // bad alloc
+        if (_lazy_size == 0)
+            return nullptr; // bad alloc
+        // Deferred merges may make up the block
+        coalesce();
+        result = _create_route(bf);
+        if (!result.success) {
+            _route.clear();
+#ifdef ASH_DEBUG_ENABLE_BUDDY_ROUTE_CORRECTNESS_CHECKING
+            _route_dbg.clear();
+#endif // !ASH_DEBUG_ENABLE_BUDDY_ROUTE_CORRECTNESS_CHECKING
+            return nullptr; // bad alloc
+        }
     }
 
     assert(!_route.empty());
@@ -93,10 +359,8 @@ buddy_system::buddy_block* buddy_system::allocate_block(uint64_t const size) {
     assert(_route.size() == _route_dbg.size());
 #endif // !ASH_DEBUG_ENABLE_BUDDY_ROUTE_CORRECTNESS_CHECKING
     assert(!_flist_v[result.blkidx].empty());
-    auto begin = _flist_v[result.blkidx].begin();
-    buddy_block* block = *begin;
+    buddy_block* block = _pop_free(result.blkidx);
     assert(block != nullptr);
-    _flist_v[result.blkidx].remove_node(begin);
 
     _route.pop();
     blkidx_t idx_dbg = result.blkidx;
@@ -115,7 +379,7 @@ buddy_system::buddy_block* buddy_system::allocate_block(uint64_t const size) {
         assert(_flist_v[target->blkidx].empty());
         _ash_unused(idx_dbg);
         idx_dbg = target->blkidx;
-        spare->inv = _flist_v[spare->blkidx].emplace_front(spare).node();
+        _push_free(spare, true);
 
         // update states
         block = target;
@@ -130,6 +394,7 @@ buddy_system::buddy_block* buddy_system::allocate_block(uint64_t const size) {
     block->in_use = true;
     block->inv = nullptr;
     _status.total_allocated += 1;
+    _on_block_granted(block, size);
 
     assert(_route.empty());
 #ifdef ASH_DEBUG_ENABLE_BUDDY_ROUTE_CORRECTNESS_CHECKING
@@ -137,13 +402,436 @@ buddy_system::buddy_block* buddy_system::allocate_block(uint64_t const size) {
 #endif // !ASH_DEBUG_ENABLE_BUDDY_ROUTE_CORRECTNESS_CHECKING
 
     assert(size <= static_cast<uint64_t>(block->cof * _align));
-    _total_allocated_size += block->cof * _align;
     return block;
 }
 
 void buddy_system::deallocate_block(buddy_block* blk) {
-    _total_allocated_size -= blk->cof * _align;
+    _on_block_released(blk);
     _deallocate(blk);
+    _dispatch_pressure_if_pending();
+}
+
+unsigned buddy_system::allocate_batch(uint64_t const size, unsigned const count, void** out) {
+    using namespace buddy_impl;
+    unsigned i = 0;
+    return _allocate_batch(size + sizeof(buddy_block**), count, [&](buddy_block* block) {
+        auto const p = static_cast<buddy_block**>(block->rgn.ptr);
+        *p = block;
+        out[i++] = p + 1;
+        ASH_BUDDY_TRACE(on_allocate(p + 1, size));
+    });
+}
+
+void buddy_system::deallocate_batch(void* const* ptrs, unsigned const count) {
+#ifdef ASH_BUDDY_SYSTEM_ALLOCATION_TRACE
+    for (unsigned i = 0; i < count; ++i)
+        ASH_BUDDY_TRACE(on_deallocate(ptrs[i]));
+#endif // !ASH_BUDDY_SYSTEM_ALLOCATION_TRACE
+    _deallocate_batch(count, [ptrs](unsigned const i) -> buddy_block* {
+        return ptrs[i] != nullptr ? *(static_cast<buddy_block**>(ptrs[i]) - 1) : nullptr;
+    });
+}
+
+unsigned buddy_system::allocate_block_batch(uint64_t const size, unsigned const count, buddy_block** out) {
+    unsigned i = 0;
+    return _allocate_batch(size, count, [&](buddy_block* block) {
+        out[i++] = block;
+    });
+}
+
+void buddy_system::deallocate_block_batch(buddy_block* const* blks, unsigned const count) {
+    _deallocate_batch(count, [blks](unsigned const i) -> buddy_block* {
+        return blks[i];
+    });
+}
+
+unsigned buddy_system::drain_remote_frees() {
+    void* p = _remote.take_all();
+    if (p == nullptr)
+        return 0;
+    // The links live in the freed memory, so the blocks are collected before any merge
+    for (; p != nullptr; p = remote_free_inbox::next(p)) {
+        ASH_BUDDY_TRACE(on_deallocate(p));
+        _drain_v.push_back(*(static_cast<buddy_block**>(p) - 1));
+    }
+    unsigned const count = static_cast<unsigned>(_drain_v.size());
+    _deallocate_batch(count, [this](unsigned const i) -> buddy_block* {
+        return _drain_v[i];
+    });
+    _drain_v.clear();
+    return count;
+}
+
+// Takes the nearest free block of the route and carves it into as many blocks of the size as needed.
+template <typename Emit>
+unsigned buddy_system::_allocate_batch(uint64_t const size, unsigned const count, Emit&& emit) {
+    using namespace buddy_impl;
+    _drain_remote_if_any();
+    if (ASH_UNLIKELY(count == 0))
+        return 0;
+    if (ASH_UNLIKELY(size > _max_blk_size)) {
+        _on_alloc_failure(size);
+        return 0;
+    }
+
+    blkidx_t const bf = _tbl.best_fit(size);
+    cof_type const need = static_cast<cof_type>((size + _align - 1) / _align);
+    unsigned n = 0;
+    bool retried = false;
+    while (n < count) {
+        auto const result = _create_route(bf);
+        _route.clear(); // the carving does not follow the route
+#ifdef ASH_DEBUG_ENABLE_BUDDY_ROUTE_CORRECTNESS_CHECKING
+        _route_dbg.clear();
+#endif // !ASH_DEBUG_ENABLE_BUDDY_ROUTE_CORRECTNESS_CHECKING
+        if (!result.success) {
+            if (_lazy_size != 0) {
+                coalesce();
+                continue;
+            }
+            if (retried || !_on_alloc_failure(size))
+                break; // bad alloc
+            retried = true;
+            continue;
+        }
+        buddy_block* block = _acquire_block(result.blkidx);
+        assert(block != nullptr && block->cof >= need);
+        n += _carve_block(block, size, need, count - n, emit);
+    }
+    _dispatch_pressure_if_pending();
+    return n;
+}
+
+// Splits a free block depth-first until the left child cannot hold `need` (or the block is at the last level);
+// blocks which are not handed out go back to the free lists.
+template <typename Emit>
+unsigned buddy_system::_carve_block(buddy_block* block, uint64_t const size, buddy_impl::cof_type const need, unsigned const count, Emit& emit) {
+    using namespace buddy_impl;
+    assert(block->in_use == false);
+    if (count == 0 || block->cof < need) {
+        _push_free(block, true);
+        return 0;
+    }
+    cof_type const left_cof = block->cof - block->cof / 2;
+    if (left_cof < need || _tbl.level(block->blkidx) == _tbl.max_level()) {
+        block->in_use = true;
+        block->inv = nullptr;
+        _status.total_allocated += 1;
+        _on_block_granted(block, size);
+        emit(block);
+        return 1;
+    }
+    buddy_block* left = _block_pool.allocate();
+    buddy_block* right = _block_pool.allocate();
+    _split_block(block, left, right, _tbl);
+    block->in_use = true;
+    unsigned const n = _carve_block(left, size, need, count, emit);
+    return n + _carve_block(right, size, need, count - n, emit);
+}
+
+/*
+ * Blocks are bucketed by level and merged from the deepest level.
+ * A parent of two merged buddies joins the bucket of its level, so every level is visited once.
+ * A buddy merged by its pair is marked as in use, and descriptors of merged buddies are released
+ * after the pass since the buckets still refer to them.
+ */
+template <typename Fetch>
+void buddy_system::_deallocate_batch(unsigned const count, Fetch&& fetch) {
+    using namespace buddy_impl;
+    std::vector<buddy_block*> released;
+    for (unsigned i = 0; i < count; ++i) {
+        buddy_block* block = fetch(i);
+        if (block == nullptr)
+            continue;
+        assert(block->in_use == true);
+        _on_block_released(block);
+        if (ASH_UNLIKELY(_is_fenced(block))) {
+            _pin_block(block);
+            continue;
+        }
+        block->in_use = false;
+        block->inv = nullptr;
+        _merge_v[_tbl.level(block->blkidx)].push_back(block);
+    }
+
+    for (level_t lv = static_cast<level_t>(_merge_v.size()); lv-- > 0;) {
+        auto& bucket = _merge_v[lv];
+        for (size_t i = 0; i < bucket.size(); ++i) {
+            buddy_block* block = bucket[i];
+            if (block->in_use)
+                continue; // already merged by its pair
+            buddy_block* pair = block->pair;
+            if (pair == nullptr || pair->in_use) {
+                _push_free(block, false);
+                continue;
+            }
+            if (pair->inv != nullptr) {
+                // The pair is in a free list
+                _flist_v[pair->blkidx].remove_node(pair->inv);
+                _on_free_list_remove(pair);
+            }
+            block->in_use = true;
+            pair->in_use = true;
+            released.push_back(block);
+            released.push_back(pair);
+            buddy_block* parent = block->parent;
+            assert(parent->in_use == true);
+            parent->in_use = false;
+            parent->left = nullptr;
+            parent->inv = nullptr;
+            _merge_v[lv - 1].push_back(parent);
+            _status.total_deallocated += 1;
+        }
+        bucket.clear();
+    }
+
+    for (buddy_block* block : released)
+        _block_pool.deallocate(block);
+    _dispatch_pressure_if_pending();
+}
+
+buddy_impl::buddy_system_snapshot buddy_system::snapshot() const {
+    using namespace buddy_impl;
+    buddy_system_snapshot s;
+    s.capacity = _max_blk_size;
+    s.free_size = 0;
+    s.used_size = 0;
+    s.largest_free = 0;
+    s.requested_size = _requested_size.load(std::memory_order_relaxed);
+    s.num_requests = 0;
+    for (unsigned i = 0; i < buddy_system_snapshot::HistogramSize; ++i) {
+        s.request_histogram[i] = _request_hist[i].load(std::memory_order_relaxed);
+        s.num_requests += s.request_histogram[i];
+    }
+    for (unsigned i = 0; i < NumReallocPaths; ++i)
+        s.realloc_count[i] = _realloc_count[i].load(std::memory_order_relaxed);
+    if (_level_counter_v == nullptr)
+        return s;
+    s.levels.reserve(_tbl.size());
+    for (blkidx_t i = 0; i < _tbl.size(); ++i) {
+        buddy_level_stats lv;
+        lv.blkidx = i;
+        lv.cof = _tbl.cof(i);
+        lv.num_free = _level_counter_v[i].num_free.load(std::memory_order_relaxed);
+        lv.num_used = _level_counter_v[i].num_used.load(std::memory_order_relaxed);
+        uint64_t const blk_size = static_cast<uint64_t>(lv.cof) * _align;
+        s.free_size += lv.num_free * blk_size;
+        s.used_size += lv.num_used * blk_size;
+        if (s.largest_free == 0 && lv.num_free > 0)
+            s.largest_free = blk_size; // coefficients are sorted in descending order
+        s.levels.push_back(lv);
+    }
+    return s;
+}
+
+void buddy_impl::buddy_system_snapshot::printout() const {
+    printf("capacity: %" PRIu64 ", free: %" PRIu64 ", used: %" PRIu64 ", requested: %" PRIu64 ", largest free: %" PRIu64 "\n",
+        capacity, free_size, used_size, requested_size, largest_free);
+    printf("external fragmentation: %.4f, internal fragmentation: %.4f\n",
+        external_fragmentation(), internal_fragmentation());
+    for (auto const& lv : levels) {
+        if (lv.num_free > 0 || lv.num_used > 0)
+            printf("%4u | %" PRId64 " | free %" PRIu64 " | used %" PRIu64 "\n", lv.blkidx, lv.cof, lv.num_free, lv.num_used);
+    }
+    printf("reallocations: unchanged %" PRIu64 ", grown %" PRIu64 ", shrunk %" PRIu64 ", moved %" PRIu64 ", failed %" PRIu64 "\n",
+        realloc_count[0], realloc_count[1], realloc_count[2], realloc_count[3], realloc_count[4]);
+    for (unsigned i = 0; i < HistogramSize; ++i) {
+        if (request_histogram[i] > 0)
+            printf("[2^%u, 2^%u) | %" PRIu64 "\n", i, i + 1, request_histogram[i]);
+    }
+}
+
+void buddy_system::_on_block_granted(buddy_block* block, uint64_t const requested) {
+    using namespace buddy_impl;
+    block->requested = requested;
+    _total_allocated_size += block->cof * _align;
+    _add_counter(_level_counter_v[block->blkidx].num_used, 1);
+    _add_counter(_requested_size, requested);
+    _add_counter(_request_hist[requested > 0 ? log2u_nz(requested) : 0], 1);
+    if (ASH_UNLIKELY(_total_allocated_size >= _pressure_up))
+        _pressure_pending = true;
+}
+
+void buddy_system::_on_block_released(buddy_block* block) {
+    block->fixed = false;
+    _total_allocated_size -= block->cof * _align;
+    _sub_counter(_level_counter_v[block->blkidx].num_used, 1);
+    _sub_counter(_requested_size, block->requested);
+    if (ASH_UNLIKELY(_total_allocated_size < _pressure_down))
+        _pressure_pending = true;
+}
+
+bool buddy_system::_on_alloc_failure(uint64_t const size) {
+    _last_failure.requested = size;
+    _last_failure.allocated_size = static_cast<uint64_t>(_total_allocated_size);
+    _last_failure.free_size = _max_blk_size - static_cast<uint64_t>(_total_allocated_size);
+    _last_failure.largest_free = largest_free_block();
+    _num_failures += 1;
+    return _failure_handler && _failure_handler(*this, _last_failure);
+}
+
+void buddy_system::set_pressure_watermarks(buddy_impl::pressure_config const& cfg) {
+    using namespace buddy_impl;
+    uint64_t const wm[NumPressureLevels] = { 0, cfg.low, cfg.high, cfg.critical };
+    for (unsigned i = 1; i < NumPressureLevels; ++i)
+        _pressure_wm[i] = wm[i] != 0 ? static_cast<int64_t>(wm[i]) : std::numeric_limits<int64_t>::max();
+    _pressure_hysteresis = static_cast<int64_t>(cfg.hysteresis);
+    // A disabled watermark may have held the current level
+    while (_pressure != pressure_level::Normal && _pressure_wm[static_cast<unsigned>(_pressure)] == std::numeric_limits<int64_t>::max())
+        _pressure = static_cast<pressure_level>(static_cast<unsigned>(_pressure) - 1);
+    _update_pressure_bounds();
+    _pressure_pending = true;
+    _dispatch_pressure();
+}
+
+unsigned buddy_system::add_pressure_callback(pressure_callback_t cb) {
+    _pressure_cb_v.emplace_back(_next_pressure_cb_id, std::move(cb));
+    return _next_pressure_cb_id++;
+}
+
+void buddy_system::remove_pressure_callback(unsigned const id) {
+    auto const it = std::find_if(_pressure_cb_v.begin(), _pressure_cb_v.end(),
+        [id](std::pair<unsigned, pressure_callback_t> const& x) { return x.first == id; });
+    if (it != _pressure_cb_v.end())
+        _pressure_cb_v.erase(it);
+}
+
+void buddy_system::_update_pressure_bounds() {
+    unsigned const lv = static_cast<unsigned>(_pressure);
+    _pressure_up = std::numeric_limits<int64_t>::max();
+    for (unsigned i = lv + 1; i < buddy_impl::NumPressureLevels; ++i)
+        _pressure_up = std::min(_pressure_up, _pressure_wm[i]);
+    _pressure_down = lv > 0 ? _pressure_wm[lv] - _pressure_hysteresis : std::numeric_limits<int64_t>::min();
+}
+
+// Moves the level to the allocated bytes and runs the callbacks per transition.
+// Callbacks may cross watermarks again; a nested call leaves it to the outer loop.
+void buddy_system::_dispatch_pressure() {
+    using namespace buddy_impl;
+    if (_in_pressure_dispatch)
+        return;
+    _in_pressure_dispatch = true;
+    while (_pressure_pending) {
+        _pressure_pending = false;
+        int64_t const allocated = _total_allocated_size;
+        unsigned lv = static_cast<unsigned>(_pressure);
+        for (unsigned i = NumPressureLevels; i-- > lv + 1;) {
+            if (allocated >= _pressure_wm[i]) {
+                lv = i;
+                break;
+            }
+        }
+        while (lv > 0 && allocated < _pressure_wm[lv] - _pressure_hysteresis) {
+            do {
+                lv -= 1;
+            } while (lv > 0 && _pressure_wm[lv] == std::numeric_limits<int64_t>::max());
+        }
+        if (lv == static_cast<unsigned>(_pressure))
+            continue;
+        pressure_event const ev{ static_cast<pressure_level>(lv), _pressure, static_cast<uint64_t>(allocated), _max_blk_size };
+        _pressure = ev.level;
+        _update_pressure_bounds();
+        auto const callbacks = _pressure_cb_v; // a callback may remove callbacks
+        for (auto const& cb : callbacks)
+            cb.second(*this, ev);
+    }
+    _in_pressure_dispatch = false;
+}
+
+/*
+ * A block grows in place while it is a left child whose right buddy is free;
+ * the buddies are merged and the parent becomes the allocated block.
+ * The path is checked before any merge, so a failed growth leaves the tree untouched.
+ */
+buddy_system::buddy_block* buddy_system::_grow_block(buddy_block* block, uint64_t const size) {
+    using namespace buddy_impl;
+    for (buddy_block const* cur = block; static_cast<uint64_t>(cur->cof) * _align < size; cur = cur->parent) {
+        buddy_block const* pair = cur->pair;
+        if (pair == nullptr || pair->in_use || pair->rgn.ptr < cur->rgn.ptr)
+            return nullptr; // not a left child, or the right buddy is in use
+    }
+
+    _on_block_released(block);
+    while (static_cast<uint64_t>(block->cof) * _align < size) {
+        buddy_block* pair = block->pair;
+        buddy_block* parent = block->parent;
+        _flist_v[pair->blkidx].remove_node(pair->inv);
+        _on_free_list_remove(pair);
+        _block_pool.deallocate(block);
+        _block_pool.deallocate(pair);
+        assert(parent->in_use == true);
+        parent->left = nullptr;
+        parent->inv = nullptr;
+        block = parent;
+        _status.total_deallocated += 1;
+    }
+    _on_block_granted(block, size);
+    return block;
+}
+
+// Splits an allocated block down to `size` bytes. A left half holding the rest of the request
+// is kept and the right half is freed; otherwise the left half is kept in use as a whole and
+// the rest of the request goes on in the right half. Returns the last block in use.
+// Blocks in use are fixed, since buddy_compactor cannot move them one by one.
+buddy_system::buddy_block* buddy_system::_trim_block(buddy_block* block, uint64_t const size) {
+    using namespace buddy_impl;
+    cof_type need = static_cast<cof_type>((size + _align - 1) / _align);
+    if (block->cof == need || _tbl.level(block->blkidx) == _tbl.max_level()) {
+        block->fixed = true;
+        return block;
+    }
+
+    _on_block_released(block);
+    uint64_t remained = size;
+    buddy_block* child[2];
+    while (block->cof > need && _tbl.level(block->blkidx) < _tbl.max_level()) {
+        child[0] = _block_pool.allocate();
+        child[1] = _block_pool.allocate();
+        block->in_use = false; // _split_block expects a free parent
+        _split_block(block, child[0], child[1], _tbl);
+        block->in_use = true;
+        if (child[0]->cof >= need) {
+            _push_free(child[1], false);
+            block = child[0];
+            continue;
+        }
+        child[0]->in_use = true;
+        child[0]->inv = nullptr;
+        _on_block_granted(child[0], child[0]->rgn.size);
+        child[0]->fixed = true;
+        remained -= child[0]->rgn.size;
+        need -= child[0]->cof;
+        block = child[1];
+    }
+    block->in_use = true;
+    block->inv = nullptr;
+    _on_block_granted(block, remained);
+    block->fixed = true;
+    return block;
+}
+
+// A block shrinks in place by splitting while its left child can hold the size; right halves are freed.
+buddy_system::buddy_block* buddy_system::_shrink_block(buddy_block* block, uint64_t const size) {
+    using namespace buddy_impl;
+    cof_type const need = static_cast<cof_type>((size + _align - 1) / _align);
+    if (block->cof - block->cof / 2 < need || _tbl.level(block->blkidx) == _tbl.max_level())
+        return block;
+
+    _on_block_released(block);
+    buddy_block* child[2];
+    while (block->cof - block->cof / 2 >= need && _tbl.level(block->blkidx) < _tbl.max_level()) {
+        child[0] = _block_pool.allocate();
+        child[1] = _block_pool.allocate();
+        block->in_use = false; // _split_block expects a free parent
+        _split_block(block, child[0], child[1], _tbl);
+        block->in_use = true;
+        _push_free(child[1], false);
+        block = child[0];
+    }
+    block->in_use = true;
+    block->inv = nullptr;
+    _on_block_granted(block, size);
+    return block;
 }
 
 buddy_impl::free_list_t* buddy_system::_init_free_list_vec(unsigned const size, buddy_impl::free_list_t::pool_type& pool) {
@@ -165,7 +853,7 @@ void buddy_system::_cleanup_free_list_vec(unsigned const size, buddy_impl::free_
         assert(i == 0 || v[i].empty());
         v[i].~free_list_t();
     }
-    delete v;
+    free(v); // allocated by calloc, and the lists are destroyed above
 }
 
 void buddy_system::_split_block(buddy_block* parent, buddy_block* left, buddy_block* right, buddy_impl::buddy_table const& tbl) {
@@ -198,9 +886,14 @@ void buddy_system::_split_block(buddy_block* parent, buddy_block* left, buddy_bl
     left->rgn.size = tbl.align() * left->cof;
     left->pair = right;
     left->parent = parent;
+    left->left = nullptr;
     left->in_use = false;
+    left->pinned = false;
+    left->fixed = false;
+    left->lazy = 0;
     left->inv = nullptr;
     left->blkidx = left_block_index(parent);
+    left->gen = 0;
 
     // right
     right->cof = parent->cof - left->cof;
@@ -208,49 +901,210 @@ void buddy_system::_split_block(buddy_block* parent, buddy_block* left, buddy_bl
     right->rgn.size = parent->rgn.size - left->rgn.size;
     right->pair = left;
     right->parent = parent;
+    right->left = nullptr;
     right->in_use = false;
+    right->pinned = false;
+    right->fixed = false;
+    right->lazy = 0;
     right->inv = nullptr;
     right->blkidx = right_block_index(parent);
+    right->gen = 0;
+
+    parent->left = left;
 }
 
 void buddy_system::_deallocate(buddy_block* block) {
     assert(block->in_use == true);
+    if (ASH_UNLIKELY(_is_fenced(block))) {
+        _pin_block(block);
+        return;
+    }
     block->in_use = false;
     buddy_block* pair = block->pair;
     if (block->pair == nullptr || pair->in_use) {
-        block->inv = _flist_v[block->blkidx].emplace_back(block).node();
+        _push_free(block, false);
         return;
     }
+    if (!_lazy_limit_v.empty() && !_coalescing && _defer_merge(block))
+        return;
     buddy_block* parent = block->parent;
     _flist_v[pair->blkidx].remove_node(pair->inv);
+    _on_free_list_remove(pair);
     _block_pool.deallocate(block);
     _block_pool.deallocate(pair);
+    parent->left = nullptr;
     _deallocate(parent);
     _status.total_deallocated += 1;
 }
 
+// Keeps a block in use (out of the free lists) until the fence is lifted.
+void buddy_system::_pin_block(buddy_block* block) {
+    assert(block->in_use == true && !block->pinned);
+    block->pinned = true;
+    _fenced.push_back(block);
+}
+
+void buddy_system::_set_fence(memrgn_t const& rgn) {
+    assert(_fence.ptr == nullptr && _fenced.empty());
+    _fence = rgn;
+}
+
+void buddy_system::_lift_fence() {
+    memset(&_fence, 0, sizeof _fence);
+    for (buddy_block* block : _fenced) {
+        block->pinned = false;
+        _deallocate(block);
+    }
+    _fenced.clear();
+}
+
+void buddy_system::enable_lazy_coalescing(buddy_impl::lazy_coalescing_config const& cfg) {
+    assert(_flist_v != nullptr);
+    unsigned const num_levels = _tbl.max_level() + 1;
+    coalesce();
+    _lazy_limit_v.assign(num_levels, cfg.default_limit);
+    for (unsigned lv = 0; lv < num_levels && lv < cfg.level_limits.size(); ++lv)
+        _lazy_limit_v[lv] = cfg.level_limits[lv];
+    _lazy_v.resize(num_levels);
+    _lazy_watermark = cfg.watermark;
+}
+
+void buddy_system::disable_lazy_coalescing() {
+    coalesce();
+    _lazy_limit_v.clear();
+}
+
+void buddy_system::coalesce() {
+    if (_lazy_size == 0)
+        return;
+    _coalescing = true;
+    for (size_t lv = _lazy_v.size(); lv-- > 0;) {
+        auto& v = _lazy_v[lv];
+        while (!v.empty()) {
+            buddy_block* block = v.back();
+            _flist_v[block->blkidx].remove_node(block->inv);
+            _on_free_list_remove(block); // leaves the lazy list
+            block->in_use = true;
+            _deallocate(block);
+        }
+    }
+    _coalescing = false;
+    assert(_lazy_size == 0);
+}
+
+// Keeps a freed block whose buddy is free in the free list without merging.
+bool buddy_system::_defer_merge(buddy_block* block) {
+    using namespace buddy_impl;
+    level_t const lv = _tbl.level(block->blkidx);
+    auto& v = _lazy_v[lv];
+    if (v.size() >= _lazy_limit_v[lv])
+        return false;
+    _push_free(block, true); // reused first
+    v.push_back(block);
+    block->lazy = static_cast<uint32_t>(v.size());
+    _lazy_size += block->rgn.size;
+    if (_lazy_watermark > 0 && _lazy_size > _lazy_watermark)
+        coalesce();
+    return true;
+}
+
+void buddy_system::_forget_lazy_block(buddy_block* block) {
+    auto& v = _lazy_v[_tbl.level(block->blkidx)];
+    uint32_t const pos = block->lazy - 1;
+    assert(pos < v.size() && v[pos] == block);
+    v[pos] = v.back();
+    v[pos]->lazy = pos + 1;
+    v.pop_back();
+    block->lazy = 0;
+    _lazy_size -= block->rgn.size;
+}
+
 void buddy_system::_cleanup() {
     //TODO: Implementation
     if (_flist_v == nullptr)
         return; // system is not initialized yet.
+    drain_remote_frees();
+    coalesce();
     if (_flist_v[0].empty()) {
         fprintf(stderr, "Buddy system detects memory leak!\n");
     }
     _cleanup_free_list_vec(_tbl.size(), _flist_v);
+    delete[] _level_counter_v;
+    _level_counter_v = nullptr;
+    _routes.clear();
+    _aligned_index.clear();
+    _address_heap_v.clear();
     _tbl.clear();
 }
 
-buddy_system::buddy_block* buddy_system::_acquire_block(buddy_impl::blkidx_t const bidx) const {
+buddy_system::buddy_block* buddy_system::_acquire_block(buddy_impl::blkidx_t const bidx) {
+    if (_flist_v[bidx].empty())
+        return nullptr;
+    return _pop_free(bidx);
+}
+
+// Takes a block from a non-empty free list by the placement policy
+buddy_system::buddy_block* buddy_system::_pop_free(buddy_impl::blkidx_t const bidx) {
     using namespace buddy_impl;
     free_list_t& list = _flist_v[bidx];
-    if (list.empty())
-        return nullptr;
-    auto begin = list.begin();
-    buddy_block* block = *begin;
-    _flist_v[bidx].remove_node(begin);
+    assert(!list.empty());
+    buddy_block* block;
+    if (_placement == placement_policy::AddressOrdered) {
+        auto& heap = _address_heap_v[bidx];
+        do {
+            assert(!heap.empty());
+            std::pop_heap(heap.begin(), heap.end(), address_greater{});
+            address_entry const e = heap.back();
+            heap.pop_back();
+            block = e.gen == e.block->gen && e.ptr == e.block->rgn.ptr && e.block->blkidx == bidx ? e.block : nullptr;
+        } while (block == nullptr);
+        list.remove_node(block->inv);
+    }
+    else {
+        auto begin = list.begin();
+        block = *begin;
+        list.remove_node(begin);
+    }
+    _on_free_list_remove(block);
     return block;
 }
 
+void buddy_system::set_placement_policy(buddy_impl::placement_policy const policy) {
+    assert(_flist_v != nullptr);
+    _placement = policy;
+    _address_heap_v.clear();
+    if (policy == buddy_impl::placement_policy::AddressOrdered)
+        _rebuild_address_heaps();
+}
+
+void buddy_system::_push_address(buddy_block* block) {
+    auto& heap = _address_heap_v[block->blkidx];
+    // Rebuilt when entries of removed blocks outnumber the blocks of the list
+    if (ASH_UNLIKELY(heap.size() >= 2 * _flist_v[block->blkidx].size() + 64)) {
+        heap.clear();
+        for (buddy_block* b : _flist_v[block->blkidx]) {
+            if (b != block)
+                heap.push_back(address_entry{ b->rgn.ptr, b, b->gen });
+        }
+        std::make_heap(heap.begin(), heap.end(), address_greater{});
+    }
+    block->gen = (block->gen + 1) | 1u;
+    heap.push_back(address_entry{ block->rgn.ptr, block, block->gen });
+    std::push_heap(heap.begin(), heap.end(), address_greater{});
+}
+
+void buddy_system::_rebuild_address_heaps() {
+    _address_heap_v.assign(_tbl.size(), std::vector<address_entry>{});
+    for (buddy_impl::blkidx_t i = 0; i < _tbl.size(); ++i) {
+        auto& heap = _address_heap_v[i];
+        for (buddy_block* b : _flist_v[i]) {
+            b->gen = (b->gen + 1) | 1u;
+            heap.push_back(address_entry{ b->rgn.ptr, b, b->gen });
+        }
+        std::make_heap(heap.begin(), heap.end(), address_greater{});
+    }
+}
+
 /*
  * * Root: 200
  * Minimum coefficient: 3
@@ -365,8 +1219,64 @@ buddy_system::buddy_block* buddy_system::_acquire_block(buddy_impl::blkidx_t con
  *                          |                        |
  *                          |                        +-- here (request: 3, result 3)
  *
+ * Route discovery with a bitmask:
+ * The lookups above probe a fixed sequence of block indices for each seed, so the sequence
+ * is recorded by buddy_route_table when the system is initialized (seed 9: 9, 8, 6, 7, 5, 4, 3, 2, 1, 0).
+ * A bitmask of non-empty free lists is maintained on every insertion and removal of the lists.
+ * The first hit of the lookups is the highest set bit of (candidates & non-empty), except that
+ * a neighbor at the same level can be probed first (e.g. 9 is probed before 8).
+ * The route is the recorded prefix of the sequence up to the hit, followed by the hit.
+ *
+ * The step-by-step lookup is kept under ASH_BUDDY_SYSTEM_LEGACY_ROUTE_DISCOVERY.
  */
 
+#ifndef ASH_BUDDY_SYSTEM_LEGACY_ROUTE_DISCOVERY
+buddy_system::routing_result buddy_system::_create_route(buddy_impl::blkidx_t const bidx) {
+    using namespace buddy_impl;
+    constexpr unsigned MaskWords = buddy_route_table::MaskWords;
+
+#ifdef ASH_BUDDY_SYSTEM_PREVENT_ROOT_ALLOC
+    // Terminate if the target block is a root node
+    if (ASH_UNLIKELY(bidx == 0))
+        return routing_result{ false, 0 }; // bad alloc
+#endif
+
+    uint64_t const* cand = _routes.candidates(bidx);
+    uint64_t hits[MaskWords];
+    blkidx_t hit = 0;
+    bool found = false;
+    for (unsigned i = MaskWords; i-- > 0;) {
+        hits[i] = cand[i] & _nonempty_mask[i];
+        if (!found && hits[i] != 0) {
+            hit = static_cast<blkidx_t>(i * 64 + 63 - count_leading_zeros(hits[i]));
+            found = true;
+        }
+    }
+    if (!found)
+        return routing_result{ false, bidx }; // bad alloc
+
+    // The neighbor at the same level may come first
+    blkidx_t const neighbor = hit - 1;
+    if (hit > 0 && _tbl.level(neighbor) == _tbl.level(hit) &&
+        (hits[neighbor / 64] & (uint64_t{ 1 } << (neighbor % 64))) &&
+        _routes.order(bidx, neighbor) < _routes.order(bidx, hit))
+        hit = neighbor;
+
+    route_entry const* route = _routes.route(bidx);
+    unsigned const len = _routes.prefix(bidx, hit);
+    for (unsigned i = 0; i < len; ++i) {
+        _route.push(route[i].offset);
+#ifdef ASH_DEBUG_ENABLE_BUDDY_ROUTE_CORRECTNESS_CHECKING
+        _route_dbg.push(route[i].idx);
+#endif // !ASH_DEBUG_ENABLE_BUDDY_ROUTE_CORRECTNESS_CHECKING
+    }
+    _route.push(_tbl.property(hit).offset);
+#ifdef ASH_DEBUG_ENABLE_BUDDY_ROUTE_CORRECTNESS_CHECKING
+    _route_dbg.push(hit);
+#endif // !ASH_DEBUG_ENABLE_BUDDY_ROUTE_CORRECTNESS_CHECKING
+    return routing_result{ true, hit };
+}
+#else
 buddy_system::routing_result buddy_system::_create_route(buddy_impl::blkidx_t bidx) {
     using namespace buddy_impl;
     auto const append_idx_to_route_if_cached = [this](blkidx_t const idx) -> bool {
@@ -383,7 +1293,7 @@ buddy_system::routing_result buddy_system::_create_route(buddy_impl::blkidx_t bi
 
 #ifdef ASH_BUDDY_SYSTEM_PREVENT_ROOT_ALLOC
     // Terminate if the target block is a root node
-    if (ASH_UNLIKELY(blkidx == 0))
+    if (ASH_UNLIKELY(bidx == 0))
         return routing_result{ false, 0 }; // bad alloc
 #endif
 
@@ -450,5 +1360,6 @@ buddy_system::routing_result buddy_system::_create_route(buddy_impl::blkidx_t bi
 
     return routing_result{ false, bidx };
 }
+#endif // !ASH_BUDDY_SYSTEM_LEGACY_ROUTE_DISCOVERY
 
 } // !namespace ash
@@ -0,0 +1,102 @@
+#include <ash/memory/compact_buddy_system.h>
+#include <ash/pointer.h>
+#include <ash/utility/dbg_log.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef __STDC_FORMAT_MACROS
+#define __STDC_FORMAT_MACROS
+#endif
+#include <inttypes.h>
+
+namespace ash {
+
+using namespace buddy_impl;
+
+compact_buddy_system::compact_buddy_system() {
+    memset(&_rgn, 0, sizeof _rgn);
+    _base = nullptr;
+    _max_blk_size = 0;
+    _allocated_size = 0;
+    _num_nodes = 0;
+    _states = nullptr;
+}
+
+compact_buddy_system::~compact_buddy_system() noexcept {
+    _cleanup();
+}
+
+compact_buddy_system::compact_buddy_system(memrgn_t const& rgn, unsigned const align, unsigned const min_cof) :
+    compact_buddy_system() {
+    init(rgn, align, min_cof);
+}
+
+bool compact_buddy_system::init(memrgn_t const& rgn, unsigned const align, unsigned const min_cof) {
+    _cleanup();
+    cof_type const root_cof = align > 0 ? static_cast<cof_type>(rgn.size / align) : 0;
+    if (align < sizeof(implicit_buddy_tree::free_link) || align % 2 != 0 || min_cof == 0 || root_cof == 0 ||
+        !is_aligned_address(rgn.ptr, align)) {
+        fprintf(stderr, "Invalid geometry of a compact buddy system! (size: %" PRIu64 ", align: %u, min_cof: %u)\n",
+            rgn.size, align, min_cof);
+        return false;
+    }
+    if (!_tree.init(root_cof, align, min_cof, "compact buddy system"))
+        return false;
+    _num_nodes = _tree.num_nodes();
+    // Zeroed pages of calloc are not touched until their nodes are used
+    _states = static_cast<uint8_t*>(calloc(_num_nodes, 1));
+    if (_states == nullptr) {
+        fprintf(stderr, "Bad alloc occured during initialize node states of the compact buddy system!\n");
+        _num_nodes = 0;
+        _tree.clear();
+        return false;
+    }
+    _rgn = rgn;
+    _base = static_cast<char*>(rgn.ptr);
+    _max_blk_size = _tree.max_alloc();
+    _allocated_size = 0;
+    _tree.attach(_states, _base, _heads, true);
+    ASH_DMESG("Compact buddy system is online. [%p, %" PRIu64 "]", rgn.ptr, rgn.size);
+    return true;
+}
+
+void* compact_buddy_system::allocate(uint64_t const size) {
+    if (ASH_UNLIKELY(size == 0 || size > _max_blk_size))
+        return nullptr;
+    uint64_t block_size;
+    uint64_t const off = _tree.allocate(size, block_size);
+    if (off == implicit_buddy_tree::NullOffset)
+        return nullptr; // bad alloc
+    _allocated_size += block_size;
+    return _base + off;
+}
+
+void compact_buddy_system::deallocate(void* p) {
+    if (p == nullptr)
+        return;
+    uint64_t const size = _tree.deallocate(static_cast<uint64_t>(static_cast<char*>(p) - _base));
+    if (size == 0) {
+        fprintf(stderr, "Invalid pointer %p is freed to a compact buddy system!\n", p);
+        return;
+    }
+    _allocated_size -= size;
+}
+
+uint64_t compact_buddy_system::usable_size(void const* p) const {
+    return _tree.block_size(static_cast<uint64_t>(static_cast<char const*>(p) - _base));
+}
+
+void compact_buddy_system::_cleanup() noexcept {
+    if (_states == nullptr)
+        return; // system is not initialized yet.
+    if (_allocated_size != 0)
+        fprintf(stderr, "Compact buddy system detects memory leak!\n");
+    free(_states);
+    _states = nullptr;
+    _num_nodes = 0;
+    _max_blk_size = 0;
+    _tree.clear();
+}
+
+} // !namespace ash
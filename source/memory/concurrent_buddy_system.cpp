@@ -0,0 +1,263 @@
+#include <ash/memory/concurrent_buddy_system.h>
+#include <atomic>
+#include <vector>
+#include <string.h> // memmove
+
+namespace ash {
+
+namespace buddy_impl {
+
+struct block_magazine {
+    unsigned count;
+    buddy_block** slots;
+};
+
+struct thread_block_cache {
+    concurrent_buddy_system* owner;
+    std::atomic<uint64_t> owner_id;
+    thread_block_cache* next;
+    thread_block_cache* prev;
+    uint64_t flush_epoch; // the last flush request of the owner seen by the thread
+    unsigned num_magazines;
+    block_magazine* magazines;
+
+    static thread_block_cache* create(concurrent_buddy_system* owner, uint64_t id, unsigned num_magazines, unsigned magazine_size);
+    static void destroy(thread_block_cache* cache) noexcept;
+    static void retire(thread_block_cache* cache);
+};
+
+} // namespace buddy_impl
+
+namespace {
+
+using buddy_impl::block_magazine;
+using buddy_impl::thread_block_cache;
+
+// Guards the binding between front ends and thread caches
+// (thread exit vs. destruction of a front end).
+std::mutex& cache_registry_lock() {
+    static std::mutex m;
+    return m;
+}
+
+std::atomic<uint64_t> next_frontend_id{ 1 };
+
+struct thread_cache_set {
+    ~thread_cache_set() {
+        std::lock_guard<std::mutex> guard{ cache_registry_lock() };
+        for (thread_block_cache* cache : caches)
+            thread_block_cache::retire(cache);
+        caches.clear();
+        last = nullptr;
+    }
+
+    std::vector<thread_block_cache*> caches;
+    thread_block_cache* last = nullptr;
+};
+
+thread_local thread_cache_set tls_caches;
+
+} // namespace
+
+namespace buddy_impl {
+
+thread_block_cache* thread_block_cache::create(concurrent_buddy_system* owner, uint64_t const id, unsigned const num_magazines, unsigned const magazine_size) {
+    auto cache = new thread_block_cache;
+    cache->owner = owner;
+    cache->owner_id.store(id, std::memory_order_relaxed);
+    cache->next = nullptr;
+    cache->prev = nullptr;
+    cache->flush_epoch = owner->_flush_epoch.load(std::memory_order_relaxed);
+    cache->num_magazines = num_magazines;
+    cache->magazines = new block_magazine[num_magazines];
+    auto slots = new buddy_block*[static_cast<size_t>(num_magazines) * magazine_size];
+    for (unsigned i = 0; i < num_magazines; ++i) {
+        cache->magazines[i].count = 0;
+        cache->magazines[i].slots = slots + static_cast<size_t>(i) * magazine_size;
+    }
+    return cache;
+}
+
+void thread_block_cache::destroy(thread_block_cache* cache) noexcept {
+    if (cache->num_magazines > 0)
+        delete[] cache->magazines[0].slots;
+    delete[] cache->magazines;
+    delete cache;
+}
+
+// Note that the cache registry lock must be held by the caller
+void thread_block_cache::retire(thread_block_cache* cache) {
+    if (cache->owner != nullptr)
+        cache->owner->_release_cache(cache);
+    destroy(cache);
+}
+
+} // namespace buddy_impl
+
+concurrent_buddy_system::concurrent_buddy_system(memrgn_t const& rgn, unsigned const align, unsigned const min_cof, unsigned const magazine_size) :
+    _buddy(rgn, align, min_cof),
+    _magazine_size(magazine_size > 0 ? magazine_size : 1),
+    _id(next_frontend_id.fetch_add(1, std::memory_order_relaxed)),
+    _flush_epoch(0),
+    _caches(nullptr) {
+}
+
+concurrent_buddy_system::~concurrent_buddy_system() noexcept {
+    std::lock_guard<std::mutex> guard{ cache_registry_lock() };
+    // Detach caches of alive threads; they are freed when their threads exit.
+    for (thread_block_cache* cache = _caches; cache != nullptr; cache = cache->next) {
+        _flush_all(cache);
+        cache->owner = nullptr;
+        cache->owner_id.store(0, std::memory_order_relaxed);
+    }
+    _caches = nullptr;
+}
+
+// Returns the blocks of the cache if another thread ran out of blocks since the last call
+ASH_FORCEINLINE void concurrent_buddy_system::_check_flush_request(thread_block_cache* cache) {
+    uint64_t const epoch = _flush_epoch.load(std::memory_order_relaxed);
+    if (ASH_UNLIKELY(cache->flush_epoch != epoch)) {
+        cache->flush_epoch = epoch;
+        _flush_all(cache);
+    }
+}
+
+void* concurrent_buddy_system::allocate(uint64_t size) {
+    using namespace buddy_impl;
+    size += sizeof(buddy_block**);
+    if (ASH_UNLIKELY(size > _buddy.max_alloc()))
+        return nullptr;
+
+    blkidx_t const bidx = _buddy.table().best_fit(size);
+    thread_block_cache* cache = _local_cache();
+    _check_flush_request(cache);
+    block_magazine& mag = cache->magazines[bidx];
+    if (ASH_UNLIKELY(mag.count == 0) && !_refill(mag, size, false)) {
+        // Blocks cached by every thread may prevent the buddy system from coalescing; the other
+        // threads return theirs at their next call
+        cache->flush_epoch = _flush_epoch.fetch_add(1, std::memory_order_relaxed) + 1;
+        _flush_all(cache);
+        if (!_refill(mag, size, true))
+            return nullptr; // bad alloc
+    }
+
+    // Headers are written when blocks leave the buddy system (see _refill)
+    buddy_block* block = mag.slots[--mag.count];
+    return static_cast<buddy_block**>(block->rgn.ptr) + 1;
+}
+
+void concurrent_buddy_system::deallocate(void* p) {
+    using namespace buddy_impl;
+    if (p == nullptr)
+        return;
+    buddy_block* block = *(static_cast<buddy_block**>(p) - 1);
+    thread_block_cache* cache = _local_cache();
+    _check_flush_request(cache);
+    block_magazine& mag = cache->magazines[block->blkidx];
+    if (ASH_UNLIKELY(mag.count == _magazine_size))
+        _flush(mag, (_magazine_size + 1) / 2);
+    mag.slots[mag.count++] = block;
+}
+
+void concurrent_buddy_system::flush_local_cache() {
+    thread_cache_set& tls = tls_caches;
+    for (thread_block_cache* cache : tls.caches) {
+        if (cache->owner_id.load(std::memory_order_relaxed) == _id) {
+            _flush_all(cache);
+            return;
+        }
+    }
+}
+
+buddy_impl::thread_block_cache* concurrent_buddy_system::_local_cache() {
+    thread_cache_set& tls = tls_caches;
+    if (ASH_LIKELY(tls.last != nullptr && tls.last->owner_id.load(std::memory_order_relaxed) == _id))
+        return tls.last;
+    for (thread_block_cache* cache : tls.caches) {
+        if (cache->owner_id.load(std::memory_order_relaxed) == _id) {
+            tls.last = cache;
+            return cache;
+        }
+    }
+    return _attach_local_cache();
+}
+
+buddy_impl::thread_block_cache* concurrent_buddy_system::_attach_local_cache() {
+    thread_cache_set& tls = tls_caches;
+    std::lock_guard<std::mutex> guard{ cache_registry_lock() };
+
+    // Drop caches of destroyed front ends
+    auto it = tls.caches.begin();
+    while (it != tls.caches.end()) {
+        if ((*it)->owner == nullptr) {
+            thread_block_cache::destroy(*it);
+            it = tls.caches.erase(it);
+        }
+        else {
+            ++it;
+        }
+    }
+
+    thread_block_cache* cache = thread_block_cache::create(this, _id, _buddy.table().size(), _magazine_size);
+    cache->next = _caches;
+    if (_caches != nullptr)
+        _caches->prev = cache;
+    _caches = cache;
+    tls.caches.push_back(cache);
+    tls.last = cache;
+    return cache;
+}
+
+// Note that the cache registry lock must be held by the caller
+void concurrent_buddy_system::_release_cache(thread_block_cache* cache) {
+    _flush_all(cache);
+    if (cache->prev != nullptr)
+        cache->prev->next = cache->next;
+    else
+        _caches = cache->next;
+    if (cache->next != nullptr)
+        cache->next->prev = cache->prev;
+    cache->owner = nullptr;
+    cache->owner_id.store(0, std::memory_order_relaxed);
+}
+
+// Only a failure of the first block with `report` is reported to the buddy system;
+// the rest of the magazine is taken while blocks are left.
+bool concurrent_buddy_system::_refill(buddy_impl::block_magazine& mag, uint64_t const size, bool const report) {
+    using namespace buddy_impl;
+    assert(mag.count == 0);
+    unsigned const count = (_magazine_size + 1) / 2;
+    std::lock_guard<std::mutex> guard{ _mtx };
+    while (mag.count < count) {
+        buddy_block* block = report && mag.count == 0 ? _buddy.allocate_block(size) : _buddy.try_allocate_block(size);
+        if (block == nullptr)
+            break;
+        *static_cast<buddy_block**>(block->rgn.ptr) = block;
+        mag.slots[mag.count++] = block;
+    }
+    return mag.count > 0;
+}
+
+void concurrent_buddy_system::_flush(buddy_impl::block_magazine& mag, unsigned const count) {
+    assert(count <= mag.count);
+    {
+        // Flush the coldest blocks (bottom of the magazine)
+        std::lock_guard<std::mutex> guard{ _mtx };
+        for (unsigned i = 0; i < count; ++i)
+            _buddy.deallocate_block(mag.slots[i]);
+    }
+    mag.count -= count;
+    memmove(mag.slots, mag.slots + count, sizeof(buddy_block*) * mag.count);
+}
+
+void concurrent_buddy_system::_flush_all(thread_block_cache* cache) {
+    std::lock_guard<std::mutex> guard{ _mtx };
+    for (unsigned i = 0; i < cache->num_magazines; ++i) {
+        block_magazine& mag = cache->magazines[i];
+        for (unsigned j = 0; j < mag.count; ++j)
+            _buddy.deallocate_block(mag.slots[j]);
+        mag.count = 0;
+    }
+}
+
+} // !namespace ash
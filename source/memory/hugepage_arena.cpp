@@ -0,0 +1,216 @@
+#include <ash/memory/hugepage_arena.h>
+#include <ash/detail/malloc.h>
+#include <ash/numeric.h>
+#include <ash/stop_watch.h>
+#include <ash/utility/dbg_log.h>
+#include <algorithm>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <stdio.h>
+
+#if defined(ASH_ENV_LINUX)
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#ifndef __STDC_FORMAT_MACROS
+#define __STDC_FORMAT_MACROS
+#endif
+#include <inttypes.h>
+
+namespace ash {
+
+namespace {
+
+#if defined(ASH_ENV_LINUX)
+// True unless transparent huge pages are disabled ("[never]")
+bool transparent_huge_pages_enabled() {
+    std::ifstream in{ "/sys/kernel/mm/transparent_hugepage/enabled" };
+    std::string line;
+    return std::getline(in, line) && line.find("[never]") == std::string::npos;
+}
+
+uint64_t transparent_huge_page_size() {
+    std::ifstream in{ "/sys/kernel/mm/transparent_hugepage/hpage_pmd_size" };
+    uint64_t size = 0;
+    return in >> size ? size : hugepage_arena::huge_page_size();
+}
+#endif
+
+char const* page_kind_name(arena_page_kind const kind) {
+    switch (kind) {
+    case arena_page_kind::Hugetlb:
+        return "hugetlb";
+    case arena_page_kind::Transparent:
+        return "transparent";
+    default:
+        return "normal";
+    }
+}
+
+} // namespace
+
+hugepage_arena::hugepage_arena() {
+    _rgn = memrgn_t{ nullptr, 0 };
+    _map_base = nullptr;
+    _map_size = 0;
+    _kind = arena_page_kind::Normal;
+    _page_size = 0;
+    _locked = false;
+    _prefault_sec = 0.0;
+}
+
+hugepage_arena::hugepage_arena(uint64_t const size, hugepage_arena_config const& cfg) :
+    hugepage_arena() {
+    map(size, cfg);
+}
+
+hugepage_arena::~hugepage_arena() noexcept {
+    unmap();
+}
+
+uint64_t hugepage_arena::huge_page_size() {
+#if defined(ASH_ENV_LINUX)
+    std::ifstream in{ "/proc/meminfo" };
+    std::string key;
+    while (in >> key) {
+        if (key == "Hugepagesize:") {
+            uint64_t kib = 0;
+            in >> kib;
+            return KiB(kib);
+        }
+        in.ignore(256, '\n');
+    }
+#endif
+    return 0;
+}
+
+bool hugepage_arena::map(uint64_t const size, hugepage_arena_config const& cfg) {
+    unmap();
+    if (size == 0)
+        return false;
+    uint64_t step = 0; // of the prefault
+#if defined(ASH_ENV_LINUX)
+    uint64_t const hp = huge_page_size();
+    if (cfg.hugetlb && hp > 0) {
+        uint64_t const rounded = roundup(size, hp);
+        void* const p = mmap(nullptr, rounded, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (p != MAP_FAILED) {
+            _map_base = p;
+            _map_size = rounded;
+            _rgn = memrgn_t{ p, rounded };
+            _kind = arena_page_kind::Hugetlb;
+            _page_size = hp;
+            step = hp;
+        }
+        else {
+            ASH_DMESG("MAP_HUGETLB is not available for %" PRIu64 " bytes; falling back", rounded);
+        }
+    }
+    if (_map_base == nullptr) {
+        uint64_t const page = static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+        uint64_t const thp = cfg.transparent && transparent_huge_pages_enabled() ? transparent_huge_page_size() : 0;
+        // A region aligned to the huge page size, so every huge page can be backed by the kernel
+        uint64_t const align = thp > page ? thp : page;
+        uint64_t const rounded = roundup(size, align);
+        uint64_t const map_size = rounded + align - page;
+        void* const p = mmap(nullptr, map_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED) {
+            perror("mmap");
+            return false;
+        }
+        void* const aligned = reinterpret_cast<void*>(roundup(reinterpret_cast<uintptr_t>(p), align));
+        _map_base = p;
+        _map_size = map_size;
+        _rgn = memrgn_t{ aligned, rounded };
+        _kind = arena_page_kind::Normal;
+        _page_size = page;
+        // A range which the kernel did not back by a huge page is faulted page by page
+        step = page;
+        if (thp > page) {
+            if (madvise(aligned, rounded, MADV_HUGEPAGE) == 0) {
+                _kind = arena_page_kind::Transparent;
+                _page_size = thp;
+            }
+            else {
+                perror("madvise");
+            }
+        }
+    }
+#else
+    _page_size = KiB(4);
+    uint64_t const rounded = roundup(size, _page_size);
+    _map_base = aligned_malloc(rounded, static_cast<size_t>(_page_size));
+    if (_map_base == nullptr)
+        return false;
+    _map_size = rounded;
+    _rgn = memrgn_t{ _map_base, rounded };
+    _kind = arena_page_kind::Normal;
+    step = _page_size;
+#endif
+
+    if (cfg.prefault)
+        _prefault(cfg.prefault_threads > 0 ? cfg.prefault_threads : std::max(1u, std::thread::hardware_concurrency()), step);
+#if defined(ASH_ENV_LINUX)
+    // Pages are locked after the parallel prefault, so mlock does not fault them one by one
+    if (cfg.lock) {
+        if (mlock(_rgn.ptr, _rgn.size) == 0)
+            _locked = true;
+        else
+            perror("mlock");
+    }
+#endif
+    return true;
+}
+
+void hugepage_arena::unmap() noexcept {
+    if (_map_base == nullptr)
+        return;
+#if defined(ASH_ENV_LINUX)
+    if (_locked)
+        munlock(_rgn.ptr, _rgn.size);
+    munmap(_map_base, _map_size);
+#else
+    aligned_free(_map_base);
+#endif
+    _rgn = memrgn_t{ nullptr, 0 };
+    _map_base = nullptr;
+    _map_size = 0;
+    _kind = arena_page_kind::Normal;
+    _page_size = 0;
+    _locked = false;
+    _prefault_sec = 0.0;
+}
+
+void hugepage_arena::printout() const {
+    printf("arena: [%p, %" PRIu64 "], pages: %s (%" PRIu64 " bytes), locked: %s, prefault: %.3f sec\n",
+        _rgn.ptr, _rgn.size, page_kind_name(_kind), _page_size, _locked ? "yes" : "no", _prefault_sec);
+}
+
+// Every thread touches a page of its own range at a time
+void hugepage_arena::_prefault(unsigned num_threads, uint64_t const step) {
+    uint64_t const num_pages = _rgn.size / step;
+    num_threads = static_cast<unsigned>(std::min<uint64_t>(num_threads, num_pages));
+    uint64_t const pages_per_thread = (num_pages + num_threads - 1) / num_threads;
+    volatile char* const base = static_cast<char*>(_rgn.ptr);
+    auto const touch = [&](unsigned const t) {
+        uint64_t const end = std::min(num_pages, (t + 1) * pages_per_thread);
+        for (uint64_t i = t * pages_per_thread; i < end; ++i)
+            base[i * step] = 0;
+    };
+
+    stop_watch sw;
+    std::vector<std::thread> threads;
+    threads.reserve(num_threads);
+    for (unsigned t = 1; t < num_threads; ++t)
+        threads.emplace_back(touch, t);
+    touch(0);
+    for (auto& th : threads)
+        th.join();
+    sw.lab();
+    _prefault_sec = sw.elapsed_sec();
+}
+
+} // !namespace ash
@@ -0,0 +1,206 @@
+#include <ash/memory/implicit_buddy_tree.h>
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+namespace ash {
+namespace buddy_impl {
+
+namespace {
+
+constexpr blkidx_t NoBlock = ~blkidx_t{ 0 };
+
+} // namespace
+
+implicit_buddy_tree::implicit_buddy_tree() {
+    _align = 0;
+    _states = nullptr;
+    _base = nullptr;
+    _heads = nullptr;
+    memset(_first_v, 0, sizeof _first_v);
+    memset(_nonempty_mask, 0, sizeof _nonempty_mask);
+}
+
+bool implicit_buddy_tree::init(cof_type const root_cof, unsigned const align, cof_type const min_cof, char const* owner) {
+    clear();
+    _tbl.init(root_cof, align, min_cof);
+    if (_tbl.size() == 0 || _tbl.size() > MaxTableSize || _tbl.max_level() >= 63) {
+        fprintf(stderr, "A buddy table of %u entries is too large for a %s!\n", _tbl.size(), owner);
+        _tbl.clear();
+        return false;
+    }
+    for (blkidx_t i = _tbl.size(); i-- > 0;)
+        _first_v[_tbl.level(i)] = i;
+    _align = align;
+    return true;
+}
+
+void implicit_buddy_tree::attach(uint8_t* const states, char* const base, uint64_t* const heads, bool const reset) {
+    assert(initialized());
+    _states = states;
+    _base = base;
+    _heads = heads;
+    memset(_nonempty_mask, 0, sizeof _nonempty_mask);
+    if (reset) {
+        for (blkidx_t i = 0; i < MaxTableSize; ++i)
+            _heads[i] = NullOffset;
+        _push_free(1, 0, 0);
+        return;
+    }
+    for (blkidx_t i = 0; i < _tbl.size(); ++i) {
+        if (_heads[i] != NullOffset)
+            _nonempty_mask[i / 64] |= uint64_t{ 1 } << (i % 64);
+    }
+}
+
+void implicit_buddy_tree::clear() noexcept {
+    _align = 0;
+    _states = nullptr;
+    _base = nullptr;
+    _heads = nullptr;
+    memset(_nonempty_mask, 0, sizeof _nonempty_mask);
+    _tbl.clear();
+}
+
+uint64_t implicit_buddy_tree::allocate(uint64_t const size, uint64_t& block_size) {
+    if (ASH_UNLIKELY(size == 0 || size > max_alloc()))
+        return NullOffset;
+    blkidx_t const best = _tbl.best_fit(size);
+    level_t const target_lv = _tbl.level(best);
+    uint64_t const need = (size + _align - 1) / _align;
+
+    // The nearest free block whose leftmost descendant at the target level holds the size,
+    // otherwise the nearest free block, which is split as long as its left half holds the size
+    blkidx_t bidx = NoBlock;
+    blkidx_t nearest = NoBlock;
+    for (unsigned w = best / 64 + 1; w-- > 0 && bidx == NoBlock;) {
+        uint64_t m = _nonempty_mask[w];
+        if (w == best / 64 && best % 64 != 63)
+            m &= (uint64_t{ 1 } << (best % 64 + 1)) - 1;
+        while (m != 0) {
+            unsigned const b = 63 - count_leading_zeros(m);
+            blkidx_t const i = w * 64 + b;
+            if (nearest == NoBlock)
+                nearest = i;
+            unsigned const d = target_lv - _tbl.level(i);
+            if (((static_cast<uint64_t>(_tbl.cof(i)) - 1) >> d) + 1 >= need) {
+                bidx = i;
+                break;
+            }
+            m &= ~(uint64_t{ 1 } << b);
+        }
+    }
+    if (bidx == NoBlock)
+        bidx = nearest;
+    if (bidx == NoBlock)
+        return NullOffset; // bad alloc
+
+    uint64_t const off = _heads[bidx];
+    uint64_t node = _link(off)->node;
+    _remove_free(off, bidx);
+    cof_type cof = _tbl.cof(bidx);
+    for (level_t lv = _tbl.level(bidx); lv < target_lv && static_cast<uint64_t>(cof - cof / 2) >= need; ++lv) {
+        cof_type const left = cof - cof / 2;
+        _states[node] = Split;
+        _push_free(node * 2 + 1, off + static_cast<uint64_t>(left) * _align, _blkidx(lv + 1, cof / 2));
+        node *= 2;
+        cof = left;
+    }
+    _states[node] = Used;
+    block_size = static_cast<uint64_t>(cof) * _align;
+    return off;
+}
+
+uint64_t implicit_buddy_tree::deallocate(uint64_t const off) {
+    node_path path;
+    _walk(off, path);
+    uint64_t node = path.node;
+    level_t lv = path.lv;
+    if (_states[node] != Used || path.off_v[lv] != off)
+        return 0;
+    uint64_t const size = static_cast<uint64_t>(path.cof_v[lv]) * _align;
+
+    // Merge with free buddies
+    while (node > 1 && _states[node ^ 1] == Free) {
+        cof_type const parent = path.cof_v[lv - 1];
+        cof_type const left = parent - parent / 2;
+        bool const is_left = (node & 0x1u) == 0;
+        uint64_t const buddy_off = is_left ? path.off_v[lv - 1] + static_cast<uint64_t>(left) * _align : path.off_v[lv - 1];
+        _remove_free(buddy_off, _blkidx(lv, is_left ? parent / 2 : left));
+        _states[node ^ 1] = Absent;
+        _states[node] = Absent;
+        node >>= 1;
+        lv -= 1;
+    }
+    _push_free(node, path.off_v[lv], _blkidx(lv, path.cof_v[lv]));
+    return size;
+}
+
+uint64_t implicit_buddy_tree::block_size(uint64_t const off) const {
+    node_path path;
+    _walk(off, path);
+    return static_cast<uint64_t>(path.cof_v[path.lv]) * _align;
+}
+
+uint64_t implicit_buddy_tree::largest_free_block() const {
+    // Block indices grow as coefficients shrink, so the lowest non-empty index is the largest block
+    for (unsigned w = 0; w < MaskWords; ++w) {
+        if (_nonempty_mask[w] != 0)
+            return static_cast<uint64_t>(_tbl.cof(w * 64 + count_trailing_zeros(_nonempty_mask[w]))) * _align;
+    }
+    return 0;
+}
+
+void implicit_buddy_tree::_walk(uint64_t const off, node_path& path) const {
+    uint64_t node = 1;
+    level_t lv = 0;
+    path.off_v[0] = 0;
+    path.cof_v[0] = _tbl.cof(0);
+    while (_states[node] == Split) {
+        cof_type const left = path.cof_v[lv] - path.cof_v[lv] / 2;
+        uint64_t const mid = path.off_v[lv] + static_cast<uint64_t>(left) * _align;
+        bool const right = off >= mid;
+        path.off_v[lv + 1] = right ? mid : path.off_v[lv];
+        path.cof_v[lv + 1] = right ? path.cof_v[lv] / 2 : left;
+        node = node * 2 + (right ? 1 : 0);
+        lv += 1;
+    }
+    path.node = node;
+    path.lv = lv;
+}
+
+// Every level holds at most two coefficients; the larger one comes first
+blkidx_t implicit_buddy_tree::_blkidx(level_t const lv, cof_type const cof) const {
+    blkidx_t const first = _first_v[lv];
+    blkidx_t const bidx = cof != _tbl.cof(first) ? first + 1 : first;
+    assert(_tbl.level(bidx) == lv && _tbl.cof(bidx) == cof);
+    return bidx;
+}
+
+void implicit_buddy_tree::_push_free(uint64_t const node, uint64_t const off, blkidx_t const bidx) {
+    uint64_t& head = _heads[bidx];
+    free_link* const link = _link(off);
+    link->node = node;
+    link->prev = NullOffset;
+    link->next = head;
+    if (head != NullOffset)
+        _link(head)->prev = off;
+    head = off;
+    _nonempty_mask[bidx / 64] |= uint64_t{ 1 } << (bidx % 64);
+    _states[node] = Free;
+}
+
+void implicit_buddy_tree::_remove_free(uint64_t const off, blkidx_t const bidx) {
+    free_link const* const link = _link(off);
+    if (link->prev != NullOffset)
+        _link(link->prev)->next = link->next;
+    else
+        _heads[bidx] = link->next;
+    if (link->next != NullOffset)
+        _link(link->next)->prev = link->prev;
+    if (_heads[bidx] == NullOffset)
+        _nonempty_mask[bidx / 64] &= ~(uint64_t{ 1 } << (bidx % 64));
+}
+
+} // !namespace buddy_impl
+} // !namespace ash
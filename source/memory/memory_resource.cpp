@@ -0,0 +1,149 @@
+#include <ash/memory/memory_resource.h>
+#include <algorithm>
+#include <new>
+
+namespace ash {
+
+namespace {
+
+// The largest power of two dividing v (v > 0)
+size_t alignment_of(uint64_t const v) noexcept {
+    return static_cast<size_t>(v & (~v + 1));
+}
+
+} // namespace
+
+void* buddy_memory_resource::do_allocate(size_t const bytes, size_t const alignment) {
+    void* p = alignment <= sizeof(buddy_impl::buddy_block*) ? _buddy.allocate(bytes) : _buddy.allocate_aligned(bytes, alignment);
+    if (p == nullptr)
+        throw std::bad_alloc{};
+    return p;
+}
+
+void buddy_memory_resource::do_deallocate(void* p, size_t, size_t const alignment) {
+    if (alignment <= sizeof(buddy_impl::buddy_block*))
+        _buddy.deallocate(p);
+    else
+        _buddy.deallocate_aligned(p);
+}
+
+bool buddy_memory_resource::do_is_equal(std::pmr::memory_resource const& other) const noexcept {
+    return this == &other;
+}
+
+segregated_storage_resource::segregated_storage_resource(segregated_storage& storage, std::pmr::memory_resource* upstream) noexcept :
+    _storage(storage), _upstream(upstream) {
+    _max_align = std::min(alignment_of(reinterpret_cast<uintptr_t>(storage.buffer)), alignment_of(storage.block_size));
+}
+
+void* segregated_storage_resource::do_allocate(size_t const bytes, size_t const alignment) {
+    if (bytes <= _storage.block_size && alignment <= _max_align) {
+        void* p = _storage.allocate();
+        if (p != nullptr)
+            return p;
+    }
+    return _upstream->allocate(bytes, alignment);
+}
+
+void segregated_storage_resource::do_deallocate(void* p, size_t const bytes, size_t const alignment) {
+    char const* const buffer = static_cast<char const*>(_storage.buffer);
+    if (static_cast<char const*>(p) >= buffer && static_cast<char const*>(p) < buffer + _storage.bufsize)
+        _storage.deallocate(p);
+    else
+        _upstream->deallocate(p, bytes, alignment);
+}
+
+bool segregated_storage_resource::do_is_equal(std::pmr::memory_resource const& other) const noexcept {
+    return this == &other;
+}
+
+buddy_pool_resource::buddy_pool_resource(buddy_system& buddy, uint64_t const chunk_size) :
+    _buddy(buddy), _chunk_size(chunk_size), _large(buddy) {
+}
+
+buddy_pool_resource::~buddy_pool_resource() noexcept {
+    release();
+}
+
+// Returns every chunk to the buddy system; blocks of the chunks must not be in use.
+void buddy_pool_resource::release() noexcept {
+    for (size_class& c : _classes) {
+        for (chunk& ch : c.chunks) {
+            ch.storage.reset();
+            _buddy.deallocate_block(ch.block);
+        }
+        c.chunks.clear();
+        c.available.clear();
+    }
+}
+
+size_t buddy_pool_resource::num_chunks() const noexcept {
+    size_t n = 0;
+    for (size_class const& c : _classes)
+        n += c.chunks.size();
+    return n;
+}
+
+unsigned buddy_pool_resource::_class_of(size_t const bytes) noexcept {
+    if (bytes <= (size_t{ 1 } << MinClassBits))
+        return 0;
+    return 64 - count_leading_zeros(bytes - 1) - MinClassBits;
+}
+
+void* buddy_pool_resource::_allocate_small(unsigned const cls) {
+    size_class& c = _classes[cls];
+    if (ASH_UNLIKELY(c.available.empty())) {
+        buddy_block* const block = _buddy.allocate_block(_chunk_size);
+        if (block == nullptr)
+            throw std::bad_alloc{};
+        chunk ch{ block, std::unique_ptr<segregated_storage>{
+            new segregated_storage{ block->rgn.ptr, _chunk_size, size_t{ 1 } << (cls + MinClassBits) } } };
+        c.available.push_back(ch.storage.get());
+        auto const pos = std::upper_bound(c.chunks.begin(), c.chunks.end(), block->rgn.ptr,
+            [](void* p, chunk const& x) { return p < x.block->rgn.ptr; });
+        c.chunks.insert(pos, std::move(ch));
+    }
+    segregated_storage* const ss = c.available.back();
+    void* p = ss->allocate();
+    assert(p != nullptr);
+    if (ss->empty())
+        c.available.pop_back(); // no free block left
+    return p;
+}
+
+void buddy_pool_resource::_deallocate_small(unsigned const cls, void* p) {
+    size_class& c = _classes[cls];
+    auto const pos = std::upper_bound(c.chunks.begin(), c.chunks.end(), p,
+        [](void* q, chunk const& x) { return q < x.block->rgn.ptr; });
+    assert(pos != c.chunks.begin());
+    segregated_storage* const ss = (pos - 1)->storage.get();
+    if (ss->empty())
+        c.available.push_back(ss);
+    ss->deallocate(p);
+}
+
+void* buddy_pool_resource::do_allocate(size_t const bytes, size_t const alignment) {
+    if (bytes <= MaxSmallSize) {
+        unsigned const cls = _class_of(bytes);
+        if (alignment <= std::min(size_t{ 1 } << (cls + MinClassBits), alignment_of(_buddy.align())))
+            return _allocate_small(cls);
+    }
+    return _large.allocate(bytes, alignment);
+}
+
+void buddy_pool_resource::do_deallocate(void* p, size_t const bytes, size_t const alignment) {
+    if (bytes <= MaxSmallSize) {
+        unsigned const cls = _class_of(bytes);
+        if (alignment <= std::min(size_t{ 1 } << (cls + MinClassBits), alignment_of(_buddy.align()))) {
+            _deallocate_small(cls, p);
+            return;
+        }
+    }
+    _large.deallocate(p, bytes, alignment);
+}
+
+bool buddy_pool_resource::do_is_equal(std::pmr::memory_resource const& other) const noexcept {
+    return this == &other;
+}
+
+} // !namespace ash
@@ -0,0 +1,159 @@
+#include <ash/memory/multi_region_buddy_system.h>
+#include <ash/detail/malloc.h>
+#include <ash/pointer.h>
+#include <algorithm>
+#include <stdio.h>
+
+#if defined(ASH_ENV_UNIX)
+#include <sys/mman.h>
+#endif
+
+namespace ash {
+
+multi_region_buddy_system::multi_region_buddy_system(unsigned const align, unsigned const min_cof) {
+    _align = align;
+    _min_cof = min_cof;
+}
+
+multi_region_buddy_system::~multi_region_buddy_system() noexcept {
+    for (auto& r : _regions)
+        _release(*r);
+}
+
+bool multi_region_buddy_system::add_region(memrgn_t const& rgn, release_callback_t release) {
+    if (rgn.ptr == nullptr || rgn.size < _align || !is_aligned_address(rgn.ptr, _align)) {
+        fprintf(stderr, "Invalid region [%p, %llu] is added to a multi-region buddy system!\n",
+            rgn.ptr, static_cast<unsigned long long>(rgn.size));
+        return false;
+    }
+    char const* const base = static_cast<char const*>(rgn.ptr);
+    auto const pos = std::upper_bound(_regions.begin(), _regions.end(), base,
+        [](char const* p, std::unique_ptr<region> const& r) { return p < static_cast<char const*>(r->rgn.ptr); });
+    bool const overlap_prev = pos != _regions.begin() &&
+        static_cast<char const*>((*(pos - 1))->rgn.ptr) + (*(pos - 1))->rgn.size > base;
+    bool const overlap_next = pos != _regions.end() && base + rgn.size > static_cast<char const*>((*pos)->rgn.ptr);
+    if (overlap_prev || overlap_next) {
+        fprintf(stderr, "Region [%p, %llu] overlaps a region of a multi-region buddy system!\n",
+            rgn.ptr, static_cast<unsigned long long>(rgn.size));
+        return false;
+    }
+
+    std::unique_ptr<region> r{ new region{ rgn, std::unique_ptr<buddy_system>{ new buddy_system{} }, std::move(release), 0 } };
+    r->buddy->init(rgn, _align, _min_cof);
+    _regions.insert(pos, std::move(r));
+    return true;
+}
+
+bool multi_region_buddy_system::add_mapped_region(uint64_t const size) {
+    uint64_t const rgn_size = size / _align * _align;
+#if defined(ASH_ENV_UNIX)
+    void* const p = mmap(nullptr, rgn_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (p == MAP_FAILED)
+        return false;
+    if (!add_region(memrgn_t{ p, rgn_size }, [](memrgn_t const& rgn) { munmap(rgn.ptr, rgn.size); })) {
+        munmap(p, rgn_size);
+        return false;
+    }
+#else
+    void* const p = aligned_malloc(rgn_size, _align);
+    if (p == nullptr)
+        return false;
+    if (!add_region(memrgn_t{ p, rgn_size }, [](memrgn_t const& rgn) { aligned_free(rgn.ptr); })) {
+        aligned_free(p);
+        return false;
+    }
+#endif
+    return true;
+}
+
+void* multi_region_buddy_system::allocate(uint64_t const size) {
+    // Best fit by the largest free block of each region
+    uint64_t const need = size + sizeof(buddy_impl::buddy_block**);
+    region* best = nullptr;
+    uint64_t best_free = 0;
+    for (auto const& r : _regions) {
+        uint64_t const largest = r->buddy->largest_free_block();
+        if (largest >= need && (best == nullptr || largest < best_free)) {
+            best = r.get();
+            best_free = largest;
+        }
+    }
+    if (best != nullptr) {
+        void* p = best->buddy->try_allocate(size);
+        if (ASH_LIKELY(p != nullptr)) {
+            best->num_live += 1;
+            return p;
+        }
+    }
+    // The route of the best fit may miss a free block of another shape
+    for (auto const& r : _regions) {
+        if (r.get() == best || r->buddy->largest_free_block() < need)
+            continue;
+        void* p = r->buddy->try_allocate(size);
+        if (p != nullptr) {
+            r->num_live += 1;
+            return p;
+        }
+    }
+    return nullptr;
+}
+
+void multi_region_buddy_system::deallocate(void* p) {
+    if (p == nullptr)
+        return;
+    region* const r = _find(p);
+    if (r == nullptr) {
+        fprintf(stderr, "Pointer %p does not belong to any region of a multi-region buddy system!\n", p);
+        return;
+    }
+    r->buddy->deallocate(p);
+    r->num_live -= 1;
+}
+
+unsigned multi_region_buddy_system::release_empty_regions(unsigned keep) {
+    unsigned released = 0;
+    for (auto it = _regions.begin(); it != _regions.end();) {
+        if ((*it)->num_live > 0 || keep > 0) {
+            keep -= (*it)->num_live == 0 ? 1 : 0;
+            ++it;
+            continue;
+        }
+        _release(**it);
+        it = _regions.erase(it);
+        released += 1;
+    }
+    return released;
+}
+
+std::vector<buddy_region_status> multi_region_buddy_system::status() const {
+    std::vector<buddy_region_status> v;
+    v.reserve(_regions.size());
+    for (auto const& r : _regions)
+        v.push_back(buddy_region_status{ r->rgn, r->buddy->max_alloc(), r->buddy->largest_free_block(), r->num_live });
+    return v;
+}
+
+uint64_t multi_region_buddy_system::max_alloc() const {
+    uint64_t size = 0;
+    for (auto const& r : _regions)
+        size = std::max(size, r->buddy->max_alloc() - sizeof(buddy_impl::buddy_block**));
+    return size;
+}
+
+multi_region_buddy_system::region* multi_region_buddy_system::_find(void const* p) const {
+    char const* const c = static_cast<char const*>(p);
+    auto const pos = std::upper_bound(_regions.begin(), _regions.end(), c,
+        [](char const* q, std::unique_ptr<region> const& r) { return q < static_cast<char const*>(r->rgn.ptr); });
+    if (pos == _regions.begin())
+        return nullptr;
+    region* const r = (pos - 1)->get();
+    return c < static_cast<char const*>(r->rgn.ptr) + r->rgn.size ? r : nullptr;
+}
+
+void multi_region_buddy_system::_release(region& r) {
+    r.buddy.reset();
+    if (r.release)
+        r.release(r.rgn);
+}
+
+} // !namespace ash
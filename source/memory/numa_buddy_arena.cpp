@@ -0,0 +1,284 @@
+#include <ash/memory/numa_buddy_arena.h>
+#include <ash/detail/malloc.h>
+#include <ash/pointer.h>
+#include <ash/utility/dbg_log.h>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+
+#if defined(ASH_ENV_LINUX)
+#include <dirent.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#ifndef __STDC_FORMAT_MACROS
+#define __STDC_FORMAT_MACROS
+#endif
+#include <inttypes.h>
+
+namespace ash {
+
+namespace {
+
+// Parses a cpu list such as "0-3,8-11"
+std::vector<unsigned> parse_cpu_list(std::string const& s) {
+    std::vector<unsigned> cpus;
+    std::stringstream ss{ s };
+    std::string range;
+    while (std::getline(ss, range, ',')) {
+        if (range.empty() || range[0] == '\n')
+            continue;
+        auto const dash = range.find('-');
+        unsigned const lo = static_cast<unsigned>(std::stoul(range.substr(0, dash)));
+        unsigned const hi = dash == std::string::npos ? lo : static_cast<unsigned>(std::stoul(range.substr(dash + 1)));
+        for (unsigned cpu = lo; cpu <= hi; ++cpu)
+            cpus.push_back(cpu);
+    }
+    return cpus;
+}
+
+std::vector<numa_node_info> single_node_topology() {
+    numa_node_info node;
+    node.id = 0;
+    unsigned const ncpus = std::max(1u, std::thread::hardware_concurrency());
+    for (unsigned cpu = 0; cpu < ncpus; ++cpu)
+        node.cpus.push_back(cpu);
+    node.distance.push_back(10);
+    return { node };
+}
+
+} // namespace
+
+std::vector<numa_node_info> discover_numa_topology() {
+#if defined(ASH_ENV_LINUX)
+    std::string const root = "/sys/devices/system/node/";
+    std::vector<numa_node_info> nodes;
+    DIR* dir = opendir(root.c_str());
+    if (dir == nullptr)
+        return single_node_topology();
+    while (dirent* ent = readdir(dir)) {
+        unsigned id;
+        if (sscanf(ent->d_name, "node%u", &id) != 1)
+            continue;
+        std::string const path = root + ent->d_name;
+        std::ifstream cpulist{ path + "/cpulist" };
+        std::ifstream distance{ path + "/distance" };
+        numa_node_info node;
+        node.id = id;
+        try {
+            std::string line;
+            if (std::getline(cpulist, line))
+                node.cpus = parse_cpu_list(line);
+        }
+        catch (std::exception const& ex) {
+            ASH_ERRLOG("Failed to parse a cpu list of NUMA node %u (%s)", id, ex.what());
+        }
+        unsigned d;
+        while (distance >> d)
+            node.distance.push_back(d);
+        if (!node.cpus.empty())
+            nodes.push_back(std::move(node)); // memory-only nodes are not used
+    }
+    closedir(dir);
+    if (nodes.empty())
+        return single_node_topology();
+    std::sort(nodes.begin(), nodes.end(), [](numa_node_info const& a, numa_node_info const& b) {
+        return a.id < b.id;
+    });
+    return nodes;
+#else
+    return single_node_topology();
+#endif
+}
+
+numa_buddy_arena::numa_buddy_arena(uint64_t const size_per_node, unsigned const align, unsigned const min_cof) :
+    numa_buddy_arena(discover_numa_topology(), size_per_node, align, min_cof) {
+}
+
+numa_buddy_arena::numa_buddy_arena(std::vector<numa_node_info> const& nodes, uint64_t const size_per_node, unsigned const align, unsigned const min_cof) {
+    for (auto const& node : nodes) {
+        bool mapped;
+        memrgn_t const rgn = _map_local_region(node.id, size_per_node, &mapped);
+        if (rgn.is_null()) {
+            ASH_ERRLOG("Failed to map a region of %" PRIu64 " bytes on NUMA node %u", size_per_node, node.id);
+            continue;
+        }
+        auto a = std::make_unique<arena>();
+        a->id = node.id;
+        a->rgn = rgn;
+        a->mapped = mapped;
+        a->buddy.init(rgn, align, min_cof);
+        a->allocated = 0;
+        a->num_allocated = 0;
+        a->num_remote = 0;
+        a->num_exhausted = 0;
+        for (unsigned cpu : node.cpus) {
+            if (cpu >= _cpu_to_arena.size())
+                _cpu_to_arena.resize(cpu + 1, -1);
+            _cpu_to_arena[cpu] = static_cast<int>(_arenas.size());
+        }
+        _arenas.push_back(std::move(a));
+    }
+
+    // Fallback order: the nearest node first
+    for (unsigned i = 0; i < _arenas.size(); ++i) {
+        auto const& dist = std::find_if(nodes.begin(), nodes.end(), [&](numa_node_info const& n) {
+            return n.id == _arenas[i]->id;
+        })->distance;
+        auto const distance_to = [&](unsigned j) -> unsigned {
+            unsigned const id = _arenas[j]->id;
+            return id < dist.size() ? dist[id] : ~0u;
+        };
+        for (unsigned j = 0; j < _arenas.size(); ++j) {
+            if (j != i)
+                _arenas[i]->fallback.push_back(j);
+        }
+        std::stable_sort(_arenas[i]->fallback.begin(), _arenas[i]->fallback.end(), [&](unsigned a, unsigned b) {
+            return distance_to(a) < distance_to(b);
+        });
+    }
+}
+
+numa_buddy_arena::~numa_buddy_arena() noexcept {
+    for (auto& a : _arenas) {
+        memrgn_t const rgn = a->rgn;
+        bool const mapped = a->mapped;
+        a.reset(); // the buddy system must be destroyed before its region
+        _unmap_region(rgn, mapped);
+    }
+}
+
+void* numa_buddy_arena::allocate(uint64_t const size) {
+    if (ASH_UNLIKELY(_arenas.empty()))
+        return nullptr;
+    unsigned const local = local_node();
+    arena& a = *_arenas[local];
+    void* p = _allocate_from(a, size);
+    if (ASH_LIKELY(p != nullptr))
+        return p;
+    a.num_exhausted.fetch_add(1, std::memory_order_relaxed);
+    for (unsigned remote : a.fallback) {
+        p = _allocate_from(*_arenas[remote], size);
+        if (p != nullptr) {
+            _arenas[remote]->num_remote.fetch_add(1, std::memory_order_relaxed);
+            return p;
+        }
+    }
+    return nullptr; // bad alloc
+}
+
+void* numa_buddy_arena::allocate_on(unsigned const node, uint64_t const size) {
+    assert(node < _arenas.size());
+    return _allocate_from(*_arenas[node], size);
+}
+
+void numa_buddy_arena::deallocate(void* p) {
+    using namespace buddy_impl;
+    if (p == nullptr)
+        return;
+    arena* a = _lookup(p);
+    assert(a != nullptr);
+    uint64_t const granted = (*(static_cast<buddy_block**>(p) - 1))->rgn.size;
+    {
+        std::lock_guard<std::mutex> guard{ a->mtx };
+        a->buddy.deallocate(p);
+    }
+    a->allocated.fetch_sub(granted, std::memory_order_relaxed);
+    a->num_allocated.fetch_sub(1, std::memory_order_relaxed);
+}
+
+unsigned numa_buddy_arena::local_node() const {
+#if defined(ASH_ENV_LINUX)
+    int const cpu = sched_getcpu();
+    if (cpu >= 0 && static_cast<size_t>(cpu) < _cpu_to_arena.size() && _cpu_to_arena[cpu] >= 0)
+        return static_cast<unsigned>(_cpu_to_arena[cpu]);
+#endif
+    return 0;
+}
+
+numa_arena_status numa_buddy_arena::status(unsigned const node) const {
+    arena const& a = *_arenas[node];
+    numa_arena_status s;
+    s.node = a.id;
+    s.capacity = a.buddy.max_alloc();
+    s.allocated = a.allocated.load(std::memory_order_relaxed);
+    s.num_allocated = a.num_allocated.load(std::memory_order_relaxed);
+    s.num_remote = a.num_remote.load(std::memory_order_relaxed);
+    s.num_exhausted = a.num_exhausted.load(std::memory_order_relaxed);
+    return s;
+}
+
+std::vector<numa_arena_status> numa_buddy_arena::status() const {
+    std::vector<numa_arena_status> v;
+    v.reserve(_arenas.size());
+    for (unsigned i = 0; i < _arenas.size(); ++i)
+        v.push_back(status(i));
+    return v;
+}
+
+memrgn_t numa_buddy_arena::_map_local_region(unsigned const node_id, uint64_t const size, bool* mapped) {
+    memrgn_t rgn{ nullptr, size };
+#if defined(ASH_ENV_LINUX)
+    void* p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (p != MAP_FAILED) {
+#if defined(SYS_mbind)
+        // Bind pages to the node before the first touch (MPOL_BIND: 2)
+        constexpr int MpolBind = 2;
+        unsigned long nodemask[16] = { 0 };
+        constexpr unsigned long MaxNode = sizeof(nodemask) * 8;
+        if (node_id < MaxNode) {
+            nodemask[node_id / (sizeof(unsigned long) * 8)] |= 1ul << (node_id % (sizeof(unsigned long) * 8));
+            if (syscall(SYS_mbind, p, size, MpolBind, nodemask, MaxNode, 0) != 0)
+                ASH_DMESG("mbind failed on NUMA node %u; pages are placed by the first touch", node_id);
+        }
+#endif
+        rgn.ptr = p;
+        *mapped = true;
+        return rgn;
+    }
+#endif
+    _ash_unused(node_id);
+    rgn.ptr = aligned_malloc(size, DiskSectorSize);
+    *mapped = false;
+    return rgn;
+}
+
+void numa_buddy_arena::_unmap_region(memrgn_t const& rgn, bool const mapped) {
+#if defined(ASH_ENV_LINUX)
+    if (mapped) {
+        munmap(rgn.ptr, rgn.size);
+        return;
+    }
+#endif
+    _ash_unused(mapped);
+    aligned_free(rgn.ptr);
+}
+
+void* numa_buddy_arena::_allocate_from(arena& a, uint64_t const size) {
+    using namespace buddy_impl;
+    void* p;
+    {
+        std::lock_guard<std::mutex> guard{ a.mtx };
+        p = a.buddy.allocate(size);
+    }
+    if (p == nullptr)
+        return nullptr;
+    a.allocated.fetch_add((*(static_cast<buddy_block**>(p) - 1))->rgn.size, std::memory_order_relaxed);
+    a.num_allocated.fetch_add(1, std::memory_order_relaxed);
+    return p;
+}
+
+numa_buddy_arena::arena* numa_buddy_arena::_lookup(void* p) const {
+    for (auto const& a : _arenas) {
+        if (p >= a->rgn.ptr && p < seek_pointer(a->rgn.ptr, a->rgn.size))
+            return a.get();
+    }
+    return nullptr;
+}
+
+} // !namespace ash
@@ -0,0 +1,252 @@
+#include <ash/memory/persistent_buddy_heap.h>
+#include <ash/numeric.h>
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+#if defined(ASH_ENV_UNIX)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace ash {
+
+using namespace buddy_impl;
+
+namespace {
+
+constexpr char HeapMagic[8] = { 'A', 'S', 'H', 'B', 'U', 'D', 'D', 'Y' };
+constexpr uint32_t HeapVersion = 1;
+constexpr uint64_t StateAlignment = 64;
+constexpr uint64_t DataAlignment = KiB(4);
+
+} // namespace
+
+struct persistent_buddy_heap::heap_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t clean;          // 1 if the heap was closed
+    uint64_t file_size;
+    uint64_t state_offset;
+    uint64_t data_offset;
+    uint64_t data_size;
+    int64_t root_cof;
+    uint32_t align;
+    uint32_t min_cof;
+    uint64_t num_nodes;
+    uint64_t allocated_size;
+    handle_t roots[NumRoots];
+    handle_t free_heads[MaxTableSize];
+};
+
+persistent_buddy_heap::persistent_buddy_heap() {
+    _fd = -1;
+    _file_size = 0;
+    _header = nullptr;
+    _states = nullptr;
+    _data = nullptr;
+    _data_size = 0;
+}
+
+persistent_buddy_heap::~persistent_buddy_heap() noexcept {
+    close();
+}
+
+// Creates (or truncates) a heap file of the capacity; the file is sparse until blocks are written.
+bool persistent_buddy_heap::create(char const* path, uint64_t const capacity, unsigned const align, unsigned const min_cof) {
+    close();
+    if (align < sizeof(implicit_buddy_tree::free_link) || align % 2 != 0 || min_cof == 0 || capacity / align == 0) {
+        fprintf(stderr, "Invalid geometry of a persistent buddy heap! (capacity: %llu, align: %u, min_cof: %u)\n",
+            static_cast<unsigned long long>(capacity), align, min_cof);
+        return false;
+    }
+    cof_type const root_cof = static_cast<cof_type>(capacity / align);
+    if (!_init_geometry(root_cof, align, min_cof))
+        return false;
+
+    uint64_t const num_nodes = _tree.num_nodes();
+    uint64_t const data_alignment = is_power_of_two(align) && align > DataAlignment ? align : DataAlignment;
+    uint64_t const state_offset = aligned_size(sizeof(heap_header), StateAlignment);
+    uint64_t const data_offset = aligned_size(state_offset + num_nodes, data_alignment);
+    uint64_t const data_size = static_cast<uint64_t>(root_cof) * align;
+    if (!_map(path, true, data_offset + data_size)) {
+        _tree.clear();
+        return false;
+    }
+
+    _header = reinterpret_cast<heap_header*>(_data);
+    memcpy(_header->magic, HeapMagic, sizeof HeapMagic);
+    _header->version = HeapVersion;
+    _header->clean = 0;
+    _header->file_size = _file_size;
+    _header->state_offset = state_offset;
+    _header->data_offset = data_offset;
+    _header->data_size = data_size;
+    _header->root_cof = root_cof;
+    _header->align = align;
+    _header->min_cof = min_cof;
+    _header->num_nodes = num_nodes;
+    _header->allocated_size = 0;
+    for (handle_t& h : _header->roots)
+        h = NullHandle;
+
+    char* const base = _data;
+    _states = reinterpret_cast<uint8_t*>(base + state_offset);
+    _data = base + data_offset;
+    _data_size = data_size;
+    _tree.attach(_states, _data, _header->free_heads, true);
+    return flush();
+}
+
+// Maps a heap file created by create() and closed by close().
+bool persistent_buddy_heap::open(char const* path) {
+    close();
+    if (!_map(path, false, 0))
+        return false;
+    heap_header* const header = reinterpret_cast<heap_header*>(_data);
+    char const* err = nullptr;
+    if (_file_size < sizeof(heap_header) || memcmp(header->magic, HeapMagic, sizeof HeapMagic) != 0)
+        err = "not a persistent buddy heap";
+    else if (header->version != HeapVersion)
+        err = "unsupported version";
+    else if (header->file_size != _file_size || header->data_offset + header->data_size != _file_size)
+        err = "truncated file";
+    else if (header->clean != 1)
+        err = "the heap was not closed";
+    else if (!_init_geometry(header->root_cof, header->align, header->min_cof))
+        err = "invalid geometry";
+    else if (header->num_nodes != _tree.num_nodes())
+        err = "mismatched allocation tree";
+    if (err != nullptr) {
+        fprintf(stderr, "Failed to open a persistent buddy heap %s: %s!\n", path, err);
+        _unmap();
+        _tree.clear();
+        return false;
+    }
+
+    char* const base = _data;
+    _header = header;
+    _states = reinterpret_cast<uint8_t*>(base + header->state_offset);
+    _data = base + header->data_offset;
+    _data_size = header->data_size;
+    _tree.attach(_states, _data, _header->free_heads, false);
+    _header->clean = 0;
+    return flush();
+}
+
+void persistent_buddy_heap::close() noexcept {
+    if (_header != nullptr) {
+        _header->clean = 1;
+        flush();
+    }
+    _unmap();
+    _header = nullptr;
+    _states = nullptr;
+    _data = nullptr;
+    _data_size = 0;
+    _tree.clear();
+}
+
+// Writes dirty pages back to the file.
+bool persistent_buddy_heap::flush() {
+    if (_header == nullptr)
+        return false;
+#if defined(ASH_ENV_UNIX)
+    if (msync(_header, _file_size, MS_SYNC) != 0) {
+        perror("msync");
+        return false;
+    }
+    return true;
+#else
+    return false;
+#endif
+}
+
+persistent_buddy_heap::handle_t persistent_buddy_heap::allocate(uint64_t const size) {
+    if (_header == nullptr || size == 0 || size > _data_size)
+        return NullHandle;
+    uint64_t block_size;
+    handle_t const h = _tree.allocate(size, block_size);
+    if (h != NullHandle)
+        _header->allocated_size += block_size;
+    return h;
+}
+
+void persistent_buddy_heap::deallocate(handle_t const h) {
+    if (h == NullHandle)
+        return;
+    assert(_header != nullptr);
+    uint64_t const size = _tree.deallocate(h);
+    if (size == 0) {
+        fprintf(stderr, "Invalid handle %llu is freed to a persistent buddy heap!\n", static_cast<unsigned long long>(h));
+        return;
+    }
+    _header->allocated_size -= size;
+}
+
+void persistent_buddy_heap::set_root(unsigned const slot, handle_t const h) {
+    assert(_header != nullptr && slot < NumRoots);
+    _header->roots[slot] = h;
+}
+
+persistent_buddy_heap::handle_t persistent_buddy_heap::root(unsigned const slot) const {
+    assert(_header != nullptr && slot < NumRoots);
+    return _header->roots[slot];
+}
+
+uint64_t persistent_buddy_heap::allocated_size() const {
+    return _header != nullptr ? _header->allocated_size : 0;
+}
+
+// Maps the whole file; the base address is stored in _data until the layout is known.
+bool persistent_buddy_heap::_map(char const* path, bool const create, uint64_t const file_size) {
+#if defined(ASH_ENV_UNIX)
+    int const fd = ::open(path, create ? O_RDWR | O_CREAT | O_TRUNC : O_RDWR, 0644);
+    if (fd < 0) {
+        perror(path);
+        return false;
+    }
+    struct stat st;
+    if (create ? ftruncate(fd, static_cast<off_t>(file_size)) != 0 : fstat(fd, &st) != 0) {
+        perror(path);
+        ::close(fd);
+        return false;
+    }
+    uint64_t const size = create ? file_size : static_cast<uint64_t>(st.st_size);
+    void* const base = size > 0 ? mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+    if (base == MAP_FAILED) {
+        fprintf(stderr, "Failed to map a persistent buddy heap %s!\n", path);
+        ::close(fd);
+        return false;
+    }
+    _fd = fd;
+    _file_size = size;
+    _data = static_cast<char*>(base);
+    return true;
+#else
+    _ash_unused(path, create, file_size);
+    fprintf(stderr, "A persistent buddy heap is not supported on this platform!\n");
+    return false;
+#endif
+}
+
+void persistent_buddy_heap::_unmap() noexcept {
+#if defined(ASH_ENV_UNIX)
+    if (_fd >= 0) {
+        munmap(_header != nullptr ? static_cast<void*>(_header) : static_cast<void*>(_data), _file_size);
+        ::close(_fd);
+    }
+#endif
+    _fd = -1;
+    _file_size = 0;
+}
+
+bool persistent_buddy_heap::_init_geometry(cof_type const root_cof, unsigned const align, unsigned const min_cof) {
+    if (root_cof <= 0 || align < sizeof(implicit_buddy_tree::free_link) || align % 2 != 0 || min_cof == 0)
+        return false;
+    return _tree.init(root_cof, align, min_cof, "persistent buddy heap");
+}
+
+} // !namespace ash
@@ -1,4 +1,10 @@
 #include <ash/memory/portable_buddy_system.h>
+#include <stdio.h>
+
+#ifndef __STDC_FORMAT_MACROS
+#define __STDC_FORMAT_MACROS
+#endif
+#include <inttypes.h>
 
 namespace ash {
 
@@ -8,17 +14,23 @@ portable_buddy_system::portable_buddy_system(memrgn_t const& rgn, unsigned align
 
 void portable_buddy_system::init(memrgn_t const& rgn, unsigned align, unsigned min_cof) {
     buddy.init(rgn, align, min_cof);
+    if (!index.init(rgn, align))
+        fprintf(stderr, "Failed to index blocks of a portable buddy system! [%p, %" PRIu64 "]\n", rgn.ptr, rgn.size);
 }
 
 void* portable_buddy_system::allocate(uint64_t size) {
     assert(size > 0);
     using namespace buddy_impl;
+    if (ASH_UNLIKELY(!index.initialized()))
+        return nullptr; // not initialized; every allocation fails
     buddy_block* block = buddy.allocate_block(size);
     if (block == nullptr)
         return nullptr;
     void* p = block->rgn.ptr;
-    assert(hashmap.find(p) == hashmap.end());
-    hashmap.emplace(p, block);
+    if (!index.insert(p, block)) {
+        buddy.deallocate_block(block);
+        return nullptr; // bad alloc
+    }
     return p;
 }
 
@@ -26,10 +38,14 @@ void portable_buddy_system::deallocate(void* p) {
     if (p == nullptr)
         return;
     using namespace buddy_impl;
-    assert(hashmap.find(p) != hashmap.end());
-    buddy_block* block = hashmap.at(p);
+    buddy_block* block = index.erase(p);
+    assert(block != nullptr && block->rgn.ptr == p);
     buddy.deallocate_block(block);
-    hashmap.erase(p);
+}
+
+uint64_t portable_buddy_system::usable_size(void const* p) const {
+    buddy_impl::buddy_block const* block = index.find(p);
+    return block != nullptr ? block->rgn.size : 0;
 }
 
 }
\ No newline at end of file
@@ -0,0 +1,156 @@
+#include <ash/memory/quota_buddy_system.h>
+#include <algorithm>
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifndef __STDC_FORMAT_MACROS
+#define __STDC_FORMAT_MACROS
+#endif
+#include <inttypes.h>
+
+namespace ash {
+
+namespace {
+
+// Bytes of a reservation not covered by the usage
+uint64_t unused_reserve(uint64_t const reserved, uint64_t const used) {
+    return reserved > used ? reserved - used : 0;
+}
+
+} // namespace
+
+quota_buddy_system::quota_buddy_system(memrgn_t const& rgn, unsigned const align, unsigned const min_cof) :
+    _buddy(rgn, align, min_cof),
+    _num_accounts(0),
+    _charged(0),
+    _unused_reserve(0) {
+}
+
+quota_buddy_system::~quota_buddy_system() noexcept {
+    for (size_t i = 0; i < _num_accounts.load(); ++i) {
+        if (_accounts[i]->used.load() != 0)
+            fprintf(stderr, "Account %s holds %" PRIu64 " bytes of a quota buddy system!\n",
+                _accounts[i]->name.c_str(), _accounts[i]->used.load());
+    }
+}
+
+unsigned quota_buddy_system::add_account(char const* name, quota_account_config const& cfg) {
+    std::lock_guard<std::mutex> guard{ _mtx };
+    size_t const n = _num_accounts.load(std::memory_order_relaxed);
+    if (n == MaxAccounts) {
+        fprintf(stderr, "A quota buddy system holds at most %u accounts!\n", MaxAccounts);
+        return NoAccount;
+    }
+    if (cfg.reserved > cfg.cap || _charged + _unused_reserve + cfg.reserved > capacity()) {
+        fprintf(stderr, "Invalid quota of account %s! (reserved: %" PRIu64 ", cap: %" PRIu64 ", unreserved: %" PRIu64 ")\n",
+            name, cfg.reserved, cfg.cap, capacity() - _charged - _unused_reserve);
+        return NoAccount;
+    }
+    std::unique_ptr<account> a{ new account };
+    a->name = name;
+    a->cfg = cfg;
+    a->used = 0;
+    a->peak = 0;
+    a->num_failures = 0;
+    a->num_waits = 0;
+    _accounts[n] = std::move(a);
+    _unused_reserve += cfg.reserved;
+    _num_accounts.store(n + 1, std::memory_order_release);
+    return static_cast<unsigned>(n);
+}
+
+unsigned quota_buddy_system::find_account(char const* name) const {
+    size_t const n = _num_accounts.load(std::memory_order_acquire);
+    for (size_t i = 0; i < n; ++i) {
+        if (strcmp(_accounts[i]->name.c_str(), name) == 0)
+            return static_cast<unsigned>(i);
+    }
+    return NoAccount;
+}
+
+void* quota_buddy_system::allocate(unsigned const account_id, uint64_t const size) {
+    assert(account_id < num_accounts());
+    account& a = *_accounts[account_id];
+    uint64_t const charge = _charge_of(size);
+    std::unique_lock<std::mutex> lock{ _mtx };
+    if (charge == 0) {
+        a.num_failures += 1;
+        return nullptr; // too large for the buddy system
+    }
+    auto const deadline = std::chrono::steady_clock::now() + a.cfg.timeout;
+    bool waited = false;
+    bool timed_out = false;
+    for (;;) {
+        if (_admits(a, charge)) {
+            void* const p = _buddy.allocate(size);
+            if (p != nullptr) {
+                // The granted block may be larger than the best fit; deallocate credits all of it
+                uint64_t const granted = _buddy.usable_size(p) + sizeof(void*);
+                uint64_t const used = a.used.load(std::memory_order_relaxed);
+                _unused_reserve -= unused_reserve(a.cfg.reserved, used) - unused_reserve(a.cfg.reserved, used + granted);
+                _charged += granted;
+                a.used.store(used + granted, std::memory_order_relaxed);
+                a.peak = std::max(a.peak, used + granted);
+                return p;
+            }
+            // The quota holds the request but no block does; frees may make one up
+        }
+        if (a.cfg.overflow == quota_overflow::Fail || timed_out)
+            break;
+        if (!waited) {
+            a.num_waits += 1;
+            waited = true;
+        }
+        // Past the deadline, one more attempt is made with the frees seen so far
+        timed_out = _credited.wait_until(lock, deadline) == std::cv_status::timeout;
+    }
+    a.num_failures += 1;
+    return nullptr;
+}
+
+void quota_buddy_system::deallocate(unsigned const account_id, void* p) {
+    if (p == nullptr)
+        return;
+    assert(account_id < num_accounts());
+    account& a = *_accounts[account_id];
+    {
+        std::lock_guard<std::mutex> guard{ _mtx };
+        uint64_t const credit = _buddy.usable_size(p) + sizeof(void*);
+        uint64_t const used = a.used.load(std::memory_order_relaxed);
+        assert(credit <= used);
+        _buddy.deallocate(p);
+        _unused_reserve += unused_reserve(a.cfg.reserved, used - credit) - unused_reserve(a.cfg.reserved, used);
+        _charged -= credit;
+        a.used.store(used - credit, std::memory_order_relaxed);
+    }
+    _credited.notify_all();
+}
+
+quota_account_status quota_buddy_system::status(unsigned const account_id) const {
+    std::lock_guard<std::mutex> guard{ _mtx };
+    account const& a = *_accounts[account_id];
+    return quota_account_status{ a.name, a.cfg.reserved, a.cfg.cap, a.used.load(std::memory_order_relaxed),
+        a.peak, a.num_failures, a.num_waits };
+}
+
+// Bytes of the best-fit block of `size` bytes through buddy_system::allocate, or 0 if none does;
+// admission is checked against it before the block is known
+uint64_t quota_buddy_system::_charge_of(uint64_t const size) const {
+    uint64_t const total = size + sizeof(void*);
+    if (total > _buddy.max_alloc())
+        return 0;
+    buddy_impl::buddy_table const& tbl = _buddy.table();
+    return static_cast<uint64_t>(tbl.cof(tbl.best_fit(total))) * _buddy.align();
+}
+
+// The account stays under its cap, and the reservations of every account are still covered
+bool quota_buddy_system::_admits(account const& a, uint64_t const charge) const {
+    uint64_t const used = a.used.load(std::memory_order_relaxed);
+    if (used + charge > a.cfg.cap)
+        return false;
+    uint64_t const reserve = _unused_reserve - unused_reserve(a.cfg.reserved, used) + unused_reserve(a.cfg.reserved, used + charge);
+    return _charged + charge + reserve <= capacity();
+}
+
+} // !namespace ash
@@ -7,36 +7,46 @@ namespace ash {
 segregated_storage::segregated_storage(void* preallocated, size_t bufsize_, size_t block_size_):
     buffer(preallocated), bufsize(bufsize_), block_size(block_size_),
     capacity(bufsize / block_size) {
+    assert(block_size >= sizeof(free_block));
     reset();
 }
 
 void* segregated_storage::allocate() {
-    if (!_free_list.empty()) {
-        void* p = _free_list.back();
-        _free_list.pop_back();
-        assert(static_cast<char*>(p) >= static_cast<char*>(buffer) &&
-            static_cast<char*>(p) < static_cast<char*>(buffer) + bufsize);
+    if (_free_list != nullptr) {
+        free_block* blk = _free_list;
+        _free_list = blk->next;
+        _num_free -= 1;
+        return blk;
+    }
+    if (_bump != _end) {
+        void* p = _bump;
+        _bump += block_size;
+        _num_free -= 1;
         return p;
     }
     return nullptr;
 }
 
 void segregated_storage::deallocate(void* p) {
-    assert(static_cast<char*>(p) >= static_cast<char*>(buffer) &&
-        static_cast<char*>(p) < static_cast<char*>(buffer) + bufsize);
-    _free_list.emplace_back(p);
+    assert(static_cast<char*>(p) >= static_cast<char*>(buffer) && static_cast<char*>(p) < _bump);
+    assert((static_cast<char*>(p) - static_cast<char*>(buffer)) % block_size == 0);
+    free_block* blk = static_cast<free_block*>(p);
+    blk->next = _free_list;
+    _free_list = blk;
+    _num_free += 1;
 }
 
 void segregated_storage::reset() {
-    _free_list.clear();
-    _free_list.resize(capacity);
-    void** p = _free_list.data();
-    for (size_t i = 0; i < capacity; ++i)
-        p[i] = seek_pointer(buffer, block_size * i);
+    _free_list = nullptr;
+    _bump = static_cast<char*>(buffer);
+    _end = static_cast<char*>(seek_pointer(buffer, block_size * capacity));
+    _num_free = capacity;
 }
 
 double segregated_storage::fill_rate() const {
-    return static_cast<double>(_free_list.size()) / static_cast<double>(_free_list.capacity());
+    if (capacity == 0)
+        return 0.0;
+    return static_cast<double>(capacity - _num_free) / static_cast<double>(capacity);
 }
 
-} // !namespace ash
\ No newline at end of file
+} // !namespace ash
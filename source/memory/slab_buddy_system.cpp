@@ -0,0 +1,208 @@
+#include <ash/memory/slab_buddy_system.h>
+#include <ash/numeric.h>
+#include <ash/pointer.h>
+#include <ash/utility/dbg_log.h>
+#include <algorithm>
+#include <limits>
+#include <new>
+#include <assert.h>
+#include <stdio.h>
+
+#ifndef __STDC_FORMAT_MACROS
+#define __STDC_FORMAT_MACROS
+#endif
+#include <inttypes.h>
+
+namespace ash {
+
+slab_buddy_system::slab_buddy_system() {
+    _max_small = 0;
+    _slab_size = 0;
+    _num_slabs = 0;
+}
+
+slab_buddy_system::~slab_buddy_system() noexcept {
+    _cleanup();
+}
+
+slab_buddy_system::slab_buddy_system(memrgn_t const& rgn, unsigned const align, unsigned const min_cof, slab_buddy_config const& cfg) :
+    slab_buddy_system() {
+    init(rgn, align, min_cof, cfg);
+}
+
+bool slab_buddy_system::init(memrgn_t const& rgn, unsigned const align, unsigned const min_cof, slab_buddy_config const& cfg) {
+    _cleanup();
+    if (cfg.max_small == 0 || cfg.max_small > MiB(1)) {
+        fprintf(stderr, "Invalid small size of a slab buddy system! (max_small: %" PRIu64 ")\n", cfg.max_small);
+        return false;
+    }
+
+    // Multiples of the granularity up to 128 bytes, then four classes per power of two
+    uint64_t const max_chunk = roundup(cfg.max_small + HeaderSize, ClassGranularity);
+    _class_size_v.clear();
+    for (uint64_t size = ClassGranularity; size <= 128 && (_class_size_v.empty() || _class_size_v.back() < max_chunk); size += ClassGranularity)
+        _class_size_v.push_back(size);
+    for (uint64_t base = 128; _class_size_v.back() < max_chunk; base *= 2) {
+        for (uint64_t size = base + base / 4; size <= base * 2 && _class_size_v.back() < max_chunk; size += base / 4)
+            _class_size_v.push_back(size);
+    }
+    if (_class_size_v.size() > std::numeric_limits<uint8_t>::max()) {
+        fprintf(stderr, "Too many size classes for a slab buddy system!\n");
+        _class_size_v.clear();
+        return false;
+    }
+    _class_of_v.assign(max_chunk / ClassGranularity + 1, 0);
+    for (size_t i = 0, cls = 0; i < _class_of_v.size(); ++i) {
+        while (_class_size_v[cls] < i * ClassGranularity)
+            cls += 1;
+        _class_of_v[i] = static_cast<uint8_t>(cls);
+    }
+    _class_v.assign(_class_size_v.size(), size_class_state{ nullptr, nullptr });
+
+    uint64_t const min_slab = aligned_size(sizeof(slab), ClassGranularity) + MinChunksPerSlab * _class_size_v.back();
+    _max_small = cfg.max_small;
+    _slab_size = std::max(cfg.slab_size, min_slab);
+    _num_slabs = 0;
+    _buddy.init(rgn, align, min_cof);
+    ASH_DMESG("Slab buddy system is online. (classes: %zu, max_small: %" PRIu64 ", slab: %" PRIu64 ")",
+        _class_size_v.size(), _max_small, _slab_size);
+    return true;
+}
+
+void* slab_buddy_system::allocate(uint64_t const size) {
+    if (size <= _max_small && size > 0) {
+        void* p = _allocate_small(_class_of(size));
+        if (ASH_LIKELY(p != nullptr))
+            return p;
+        // No block for a slab; a smaller block of the buddy system may still hold the request
+    }
+    return _buddy.allocate(size);
+}
+
+void slab_buddy_system::deallocate(void* p) {
+    if (p == nullptr)
+        return;
+    uintptr_t* const header = static_cast<uintptr_t*>(p) - 1;
+    if ((*header & SlabTag) == 0) {
+        _buddy.deallocate(p);
+        return;
+    }
+    _deallocate_small(reinterpret_cast<slab*>(*header & ~SlabTag), header);
+}
+
+uint64_t slab_buddy_system::usable_size(void const* p) const {
+    uintptr_t const word = *(static_cast<uintptr_t const*>(p) - 1);
+    if ((word & SlabTag) == 0)
+        return _buddy.usable_size(p);
+    return reinterpret_cast<slab const*>(word & ~SlabTag)->storage.block_size - HeaderSize;
+}
+
+unsigned slab_buddy_system::release_empty_slabs() {
+    unsigned n = 0;
+    for (size_class_state& c : _class_v) {
+        if (c.spare != nullptr) {
+            _destroy_slab(c.spare);
+            c.spare = nullptr;
+            n += 1;
+        }
+    }
+    return n;
+}
+
+void* slab_buddy_system::_allocate_small(unsigned const cls) {
+    size_class_state& c = _class_v[cls];
+    slab* s = c.partial;
+    if (ASH_UNLIKELY(s == nullptr)) {
+        if (c.spare != nullptr) {
+            s = c.spare;
+            c.spare = nullptr;
+        }
+        else {
+            s = _create_slab(cls);
+            if (s == nullptr)
+                return nullptr;
+        }
+        _link(s);
+    }
+    auto const chunk = static_cast<uintptr_t*>(s->storage.allocate());
+    assert(chunk != nullptr);
+    if (s->storage.empty())
+        _unlink(s); // no free chunk left
+    *chunk = reinterpret_cast<uintptr_t>(s) | SlabTag;
+    return chunk + 1;
+}
+
+void slab_buddy_system::_deallocate_small(slab* s, void* chunk) {
+    s->storage.deallocate(chunk);
+    if (!s->storage.full()) {
+        if (!s->listed)
+            _link(s);
+        return;
+    }
+    // Every chunk is free; the slab is kept as the spare of its class or returned
+    if (s->listed)
+        _unlink(s);
+    size_class_state& c = _class_v[s->cls];
+    if (c.spare == nullptr)
+        c.spare = s;
+    else
+        _destroy_slab(s);
+}
+
+slab_buddy_system::slab* slab_buddy_system::_create_slab(unsigned const cls) {
+    // Not a failure of the caller yet; allocate falls back to a block of the buddy system
+    buddy_impl::buddy_block* const block = _buddy.try_allocate_block(_slab_size);
+    if (block == nullptr)
+        return nullptr;
+    block->fixed = true; // chunks point back to the slab, so buddy_compactor must not move it
+    slab* const s = static_cast<slab*>(block->rgn.ptr);
+    uint64_t const offset = aligned_size(sizeof(slab), ClassGranularity);
+    new (&s->storage) segregated_storage(seek_pointer(block->rgn.ptr, offset), block->rgn.size - offset, _class_size_v[cls]);
+    s->block = block;
+    s->prev = nullptr;
+    s->next = nullptr;
+    s->cls = cls;
+    s->listed = false;
+    _num_slabs += 1;
+    return s;
+}
+
+void slab_buddy_system::_destroy_slab(slab* s) {
+    buddy_impl::buddy_block* const block = s->block;
+    s->storage.~segregated_storage();
+    _buddy.deallocate_block(block);
+    _num_slabs -= 1;
+}
+
+void slab_buddy_system::_link(slab* s) {
+    slab*& head = _class_v[s->cls].partial;
+    s->prev = nullptr;
+    s->next = head;
+    if (head != nullptr)
+        head->prev = s;
+    head = s;
+    s->listed = true;
+}
+
+void slab_buddy_system::_unlink(slab* s) {
+    if (s->prev != nullptr)
+        s->prev->next = s->next;
+    else
+        _class_v[s->cls].partial = s->next;
+    if (s->next != nullptr)
+        s->next->prev = s->prev;
+    s->prev = nullptr;
+    s->next = nullptr;
+    s->listed = false;
+}
+
+// Slabs with live chunks are left to the buddy system, which reports them as a leak
+void slab_buddy_system::_cleanup() noexcept {
+    release_empty_slabs();
+    if (_num_slabs != 0)
+        fprintf(stderr, "Slab buddy system detects memory leak! (%zu slabs in use)\n", _num_slabs);
+    _class_v.clear();
+    _num_slabs = 0;
+}
+
+} // !namespace ash